@@ -0,0 +1,41 @@
+#!/bin/sh
+# Compare the cost of the app under each toolchain/runtime: build the
+# benchmark (ENABLE_BENCH, with the sensor stubs) in bld/<runtime>, and
+# report its code size, its FRAM and SRAM footprint, and the cycles per
+# packet (a full cycle of the cascade) in the simulator.
+#
+# gcc and clang build the libchain app (src/main.c); mementos and dino
+# build the same pipeline as a plain C loop (src/loop.c, APP_LOOP), without
+# libchain, so each row is the cost of one runtime alone. The loop covers
+# the base configuration only: compare with no optional stage enabled.
+#
+# Usage: ./compare.sh [runtime...]     (default: gcc clang mementos dino)
+#
+# Sections are counted by address (FR5969: SRAM at 0x1c00-0x23ff, FRAM from
+# 0x4400), so that the runtimes' own sections (e.g. checkpoint areas) are
+# counted wherever they go. Code is the executable part of FRAM.
+
+cd "$(dirname "$0")" || exit 1
+
+RUNTIMES=${*:-gcc clang mementos dino}
+SIZE=${SIZE:-msp430-elf-size}
+
+printf "%-14s %8s %8s %8s %14s\n" runtime code fram sram cycles/packet
+for rt in $RUNTIMES; do
+    if ! make -s -C "$rt" ENABLE_BENCH=1 > "$rt/compare.log" 2>&1; then
+        printf "%-14s build failed, see bld/%s/compare.log\n" "$rt" "$rt"
+        continue
+    fi
+
+    footprint=$($SIZE -A "$rt/spacedata.out" | awk '
+        $3 ~ /^[0-9]+$/ && $2 > 0 {
+            if ($3 >= 17408) { fram += $2; if ($1 ~ /text/) code += $2 }
+            else if ($3 >= 7168 && $3 < 9216) sram += $2
+        }
+        END { printf "%8u %8u %8u", code, fram, sram }')
+
+    cycles=$(make -s -C "$rt" ENABLE_BENCH=1 sim 2>> "$rt/compare.log" |
+             awk '$1 == "cycles/packet" { print $2 }')
+
+    printf "%-14s %s %14s\n" "$rt" "$footprint" "${cycles:-?}"
+done
@@ -0,0 +1,323 @@
+#!/bin/sh
+# Memory footprint of a build, attributed to what the app declares: each
+# channel (with the bytes of each field of its message as laid out by
+# libchain, i.e. with its timestamps and self channel double buffering),
+# each task (code and task struct), each variable and buffer, and, from
+# the link map if there is one, each object file and library.
+#
+# Usage: ./footprint.sh [-r] [-b baseline] elf [map]
+#
+#   -r           print the raw footprint, one entry per line (kind, region,
+#                bytes, name), to save as a baseline
+#   -b baseline  show the change of each entry since the baseline, and the
+#                entries that are gone
+#
+# Regions are by address, as in compare.sh (FR5969: SRAM at 0x1c00-0x23ff,
+# FRAM from 0x4400, anything else is "other"). The totals are of the
+# sections, so they include what no symbol accounts for (e.g. string
+# literals, padding). The fields of the channels need the debug info (-g).
+
+READELF=${READELF:-msp430-elf-readelf}
+
+usage() {
+    echo "usage: $0 [-r] [-b baseline] elf [map]" >&2
+    exit 2
+}
+
+raw=0
+baseline=
+while getopts rb: opt; do
+    case $opt in
+        r) raw=1 ;;
+        b) baseline=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+elf=$1
+map=$2
+[ -n "$elf" ] && [ -f "$elf" ] || usage
+
+AWKLIB='
+function region(addr) {
+    if (addr >= 17408) return "FRAM"
+    if (addr >= 7168 && addr < 9216) return "SRAM"
+    return "other"
+}
+function hex(s,    i, c, v) {
+    sub(/^0x/, "", s)
+    v = 0
+    for (i = 1; i <= length(s); ++i) {
+        c = index("0123456789abcdef", tolower(substr(s, i, 1)))
+        if (!c) break
+        v = v * 16 + c - 1
+    }
+    return v
+}'
+
+# Totals of the allocated sections: code (executable) and data per region
+sections() {
+    $READELF -SW "$elf" | awk "$AWKLIB"'
+        {
+            sub(/^ *\[ *[0-9]+\] */, "")
+            if ($2 ~ /^(NOBITS|PROGBITS|INIT_ARRAY|FINI_ARRAY)$/ && $7 ~ /A/) {
+                kind = $7 ~ /X/ ? "code" : "data"
+                total[region(hex($3)) " " kind] += hex($5)
+            }
+        }
+        END { for (k in total) { split(k, a, " "); print "total", a[1], total[k], a[2] } }'
+}
+
+# Symbols: the channels and tasks by their libchain names (_ch_<src>_<dest>,
+# _task_<func>), the rest as code or variables; statics get the name of
+# their source file (the FILE symbol before them), as in name@file.c
+symbols() {
+    $READELF -sW "$elf" | awk "$AWKLIB"'
+        $1 ~ /^[0-9]+:$/ && NF >= 8 {
+            type = $4; name = $8
+            if (type == "FILE") { file = name; next }
+            size = $3 ~ /^0x/ ? hex($3) : $3 + 0
+            if (size == 0 || (type != "OBJECT" && type != "FUNC")) next
+            if ($5 == "LOCAL" && file != "") name = name "@" file
+            if (name ~ /^_task_/) task[substr(name, 7)] = 1
+            ++n; s_type[n] = type; s_name[n] = name; s_size[n] = size
+            s_reg[n] = region(hex($2))
+        }
+        END {
+            for (i = 1; i <= n; ++i) {
+                name = s_name[i]
+                if (s_type[i] == "FUNC")
+                    kind = name in task ? "task" : "code"
+                else if (name ~ /^_task_/)
+                    kind = "task"
+                else if (name ~ /^_ch_/)
+                    kind = "chan"
+                else
+                    kind = "var"
+                print kind, s_reg[i], s_size[i], name
+            }
+        }'
+}
+
+# The fields of each channel, from the debug info: the members of its
+# message (the "data" member of the channel struct), each one up to the
+# next (so with its padding), and the rest of the channel struct as
+# <channel>.(libchain)
+fields() {
+    $READELF --debug-dump=info "$elf" 2>/dev/null | awk '
+        function value(s,    i) {
+            if (!index(s, "): "))
+                sub(/^[^:]*:[ \t]*/, "", s)
+            while ((i = index(s, "): ")))
+                s = substr(s, i + 3)
+            return s
+        }
+        function resolve(t) {
+            while (t in tag && (tag[t] == "DW_TAG_typedef" || tag[t] == "DW_TAG_const_type" ||
+                                tag[t] == "DW_TAG_volatile_type"))
+                t = type[t]
+            return t
+        }
+        function report(chan, s, size,    i, m, end) {
+            for (i = 1; i <= nchild[s]; ++i) {
+                m = child[s, i]
+                end = i < nchild[s] ? loc[child[s, i + 1]] : size
+                print "field", "-", end - loc[m], chan "." name[m]
+            }
+        }
+        /^ *<[0-9a-f]+><[0-9a-f]+>: Abbrev Number: [1-9]/ {
+            split($1, p, /[<>]/)
+            depth = p[2] + 0; die = p[4]
+            t = $0; sub(/.*\(/, "", t); sub(/\).*/, "", t)
+            tag[die] = t
+            stack[depth] = die
+            if (t == "DW_TAG_variable") var[++nvar] = die
+            if (t == "DW_TAG_member" && depth > 0) {
+                parent = stack[depth - 1]
+                child[parent, ++nchild[parent]] = die
+            }
+            next
+        }
+        /DW_AT_name/ { name[die] = value($0); next }
+        /DW_AT_type/ { t = $0; sub(/.*<0x/, "", t); sub(/>.*/, "", t); type[die] = t; next }
+        /DW_AT_byte_size/ { bsize[die] = value($0) + 0; next }
+        /DW_AT_data_member_location/ {
+            t = $0
+            if (t ~ /DW_OP_plus_uconst/) {
+                sub(/.*DW_OP_plus_uconst: */, "", t)
+                sub(/\).*/, "", t)
+            } else {
+                t = value(t)
+            }
+            loc[die] = t + 0
+            next
+        }
+        /DW_AT_declaration/ { decl[die] = 1; next }
+        END {
+            for (v = 1; v <= nvar; ++v) {
+                d = var[v]
+                if (decl[d] || name[d] !~ /^_ch_/ || !(d in type) || (name[d] in done))
+                    continue
+                done[name[d]] = 1
+
+                s = resolve(type[d])
+                data = ""
+                for (i = 1; i <= nchild[s]; ++i)
+                    if (name[child[s, i]] == "data")
+                        data = child[s, i]
+                if (data == "") {
+                    report(name[d], s, bsize[s])
+                    continue
+                }
+                msg = resolve(type[data])
+                report(name[d], msg, bsize[msg])
+                print "field", "-", bsize[s] - bsize[msg], name[d] ".(libchain)"
+            }
+        }'
+}
+
+# Input sections of the link map, by object file (or library, for an
+# archive member)
+objects() {
+    [ -n "$map" ] && [ -f "$map" ] || return 0
+    awk "$AWKLIB"'
+        /^Linker script and memory map/ { on = 1; next }
+        !on { next }
+        # An input section, possibly with its name on a line of its own;
+        # the sections that are not loaded (debug info etc.) do not count
+        /^ [._A-Za-z][^ ]*$/ { pending = $1; next }
+        (pending != "" && /^ +0x[0-9a-f]+ +0x[0-9a-f]+ +[^ ]/) ||
+        /^ [._A-Za-z][^ ]* +0x[0-9a-f]+ +0x[0-9a-f]+ +[^ ]/ {
+            if (pending != "") {
+                sect = pending; f = 1
+            } else {
+                sect = $1; f = 2
+            }
+            pending = ""
+            size = hex($(f + 1)); obj = $(f + 2)
+            if (size == 0 || sect ~ /^\.(debug|comment|note|stab|gnu\.attributes|MSP430\.attributes)/)
+                next
+            sub(/\(.*/, "", obj)
+            sub(/.*\//, "", obj)
+            bytes[region(hex($f)) " " obj] += size
+            next
+        }
+        { pending = "" }
+        END { for (k in bytes) { split(k, a, " "); print "obj", a[1], bytes[k], a[2] } }' "$map"
+}
+
+if [ $raw = 1 ]; then
+    { sections; symbols; fields; objects; } | sort -k1,1 -k4,4 -k2,2
+    exit 0
+fi
+
+{ sections; symbols; fields; objects; } | awk -v baseline="$baseline" '
+    function change(k) {
+        if (baseline == "") return ""
+        if (!(k in base)) return "new"
+        return bytes[k] == base[k] ? "" : sprintf("%+d", bytes[k] - base[k])
+    }
+    function row(label, k) {
+        printf "%-48s %-5s %7u %7s\n", label, reg[k] == "-" ? "" : reg[k], bytes[k], change(k)
+    }
+    # Entries of a kind, largest first (then by name)
+    function select(what, a,    k, n, i, j, t) {
+        n = 0
+        for (k in kind)
+            if (kind[k] == what) a[++n] = k
+        for (i = 2; i <= n; ++i)
+            for (j = i; j > 1 && (bytes[a[j]] > bytes[a[j - 1]] ||
+                                  bytes[a[j]] == bytes[a[j - 1]] && a[j] < a[j - 1]); --j) {
+                t = a[j]; a[j] = a[j - 1]; a[j - 1] = t
+            }
+        return n
+    }
+    # _ch_<src>_<dest> as src -> dest, with the tasks known from their
+    # _task_ symbols (a multicast channel is named after the source task
+    # and the channel name)
+    function chan_label(sym,    s, t, src) {
+        s = substr(sym, 5)
+        sub(/^mc_/, "", s)
+        for (t in taskname)
+            if (index(s, t "_") == 1 && length(t) > length(src))
+                src = t
+        if (src == "")
+            return s
+        t = substr(s, length(src) + 2)
+        return t == src ? src " (self)" : src " -> " t
+    }
+    BEGIN {
+        while (baseline != "" && (getline line < baseline) > 0) {
+            split(line, a, " ")
+            k = a[1] " " a[2] " " a[4]
+            base[k] = a[3]
+            base_line[k] = line
+        }
+    }
+    {
+        k = $1 " " $2 " " $4
+        kind[k] = $1; reg[k] = $2; bytes[k] = $3; sym[k] = $4
+        has[$1] = 1
+        if ($1 == "task" && $4 ~ /^_task_/) taskname[substr($4, 7)] = 1
+        if ($1 == "field") {
+            c = $4; sub(/\..*/, "", c)
+            field[c, ++nfield[c]] = k
+        }
+    }
+    END {
+        printf "%-48s %-5s %7s %7s\n", "", "", "bytes", baseline != "" ? "change" : ""
+        n = select("total", a)
+        for (i = 1; i <= n; ++i)
+            row(sym[a[i]], a[i])
+
+        print "\nchannels (and their fields)"
+        n = select("chan", a)
+        for (i = 1; i <= n; ++i) {
+            row("  " chan_label(sym[a[i]]), a[i])
+            c = sym[a[i]]
+            for (j = 1; j <= nfield[c]; ++j) {
+                f = field[c, j]
+                label = sym[f]; sub(/^[^.]*\./, "", label)
+                row("      " label, f)
+            }
+        }
+
+        print "\ntasks (code, then task struct)"
+        n = select("task", a)
+        for (i = 1; i <= n; ++i)
+            if (sym[a[i]] !~ /^_task_/) {
+                row("  " sym[a[i]], a[i])
+                for (k in kind)
+                    if (kind[k] == "task" && sym[k] == "_task_" sym[a[i]])
+                        row("      struct", k)
+            }
+
+        print "\nvariables"
+        n = select("var", a)
+        for (i = 1; i <= n; ++i) {
+            label = sym[a[i]]
+            if (sub(/@/, " (", label)) label = label ")"
+            row("  " label, a[i])
+        }
+
+        n = select("code", a)
+        print "\nother code (" n " functions, largest first)"
+        for (i = 1; i <= n && i <= 20; ++i)
+            row("  " sym[a[i]], a[i])
+
+        n = select("obj", a)
+        if (n) {
+            print "\nobject files and libraries (from the map)"
+            for (i = 1; i <= n; ++i)
+                row("  " sym[a[i]], a[i])
+        }
+
+        # Not the kinds missing altogether (no map, no debug info)
+        gone = 0
+        for (k in base)
+            if (!(k in bytes) && has[substr(k, 1, index(k, " ") - 1)]) {
+                if (!gone++) print "\ngone since the baseline"
+                split(base_line[k], b, " ")
+                printf "%-48s %-5s %7s %+7d\n", "  " b[1] " " b[4], b[2] == "-" ? "" : b[2], "", -b[3]
+            }
+    }'
@@ -0,0 +1,98 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libmsp/mem.h>
+
+#include "archive.h"
+
+#define BLOCK(b) ring[(b) & (ARCHIVE_BLOCKS - 1)]
+
+static __nv uint8_t ring[ARCHIVE_BLOCKS][ARCHIVE_BLOCK_SIZE];
+
+// Mailbox for archive_request(): the request count goes up last, and a
+// request is served when the archive state catches up with it
+static __nv volatile uint16_t req_seq;
+static __nv volatile uint8_t req_count;
+
+static void start_block(archive_t *a, int16_t *last, unsigned n)
+{
+  uint8_t *b = BLOCK(a->block);
+  b[0] = a->seq & 0xff;
+  b[1] = a->seq >> 8;
+  b[2] = 0;
+  b[3] = n;
+  a->used = ARCHIVE_HDR_SIZE;
+  for (unsigned i = 0; i < n; ++i)
+    last[i] = 0;
+}
+
+static void close_block(archive_t *a)
+{
+  uint8_t *b = BLOCK(a->block);
+  memset(b + a->used, 0, ARCHIVE_BLOCK_SIZE - a->used);
+  b[2] = a->used;
+  ++a->block;
+  if (a->full < ARCHIVE_BLOCKS - 2)
+    ++a->full;
+}
+
+void archive_append(archive_t *a, int16_t *last, const int16_t *values, unsigned n)
+{
+  if (!a->used)
+    start_block(a, last, n);
+
+  unsigned size = 0;
+  uint8_t scratch[ARCHIVE_VARINT_MAX];
+  for (unsigned i = 0; i < n; ++i)
+    size += archive_put(scratch, values[i], last[i]);
+  if (a->used + size > ARCHIVE_BLOCK_SIZE) {
+    close_block(a);
+    start_block(a, last, n);
+  }
+
+  uint8_t *b = BLOCK(a->block);
+  unsigned used = a->used;
+  for (unsigned i = 0; i < n; ++i) {
+    used += archive_put(b + used, values[i], last[i]);
+    last[i] = values[i];
+  }
+  a->used = used;
+  ++a->seq;
+}
+
+bool archive_next(archive_t *a, uint16_t *next)
+{
+  uint16_t oldest = a->block - a->full;
+
+  uint8_t count = req_count;
+  if (count != a->served) {
+    uint16_t seq = req_seq;
+    a->served = count;
+
+    // The newest block that starts at or before the record, if any
+    *next = oldest;
+    for (uint16_t b = a->block; b != (uint16_t)(oldest - 1); --b) {
+      if ((b != a->block || a->used) &&
+          (int16_t)(seq - archive_block_seq(BLOCK(b))) >= 0) {
+        *next = b;
+        break;
+      }
+    }
+  }
+
+  if ((uint16_t)(a->block - *next) > a->full)
+    *next = oldest;
+  return *next != a->block;
+}
+
+const uint8_t *archive_block(uint16_t block)
+{
+  return BLOCK(block);
+}
+
+void archive_request(uint16_t seq)
+{
+  req_seq = seq;
+  ++req_count;
+}
@@ -0,0 +1,126 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+// Long-term archive of the cascade outputs in FRAM (ENABLE_ARCHIVE): every
+// window average of every level of every run of the cascade, not only the
+// ones that go in the packets, delta-coded into a ring of blocks. The
+// downlink sends the blocks in the spare link time, oldest first, or from
+// the block that holds a record requested by the ground (archive_request).
+//
+// A block is ARCHIVE_BLOCK_SIZE bytes, and goes on the link as is, in a
+// frame of its own. The ground tells it from a packet by the CRC of the
+// frame (ENABLE_LINK_CRC): a frame that fails the CRC as a packet is tried
+// as a block (see tools/linkdec -a, which needs -c):
+//
+//   seq     2  sequence number of the first record (LSB first)
+//   len     1  bytes used, header included (the rest is zero)
+//   values  1  values per record
+//   records    one per run of the cascade, in order
+//
+// A record has, for each level, the fields of the window in packed units
+// (as pkt_win_t, i.e. as in the packets), then with ENABLE_AUTORANGE its
+// range code. Each value is coded as its difference from the same value in
+// the previous record of the block (from 0 in the first one), zigzag-coded
+// (0, -1, 1, -2, ... as 0, 1, 2, 3, ...) into a varint: 7 bits per byte,
+// LSB first, the top bit set on all but the last byte. A record never
+// spans two blocks, so that each block decodes on its own; when the ring is
+// full, the oldest block is overwritten.
+//
+// The codec is portable, so that host tools decode with the same code.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ARCHIVE_HDR_SIZE 4
+#define ARCHIVE_VARINT_MAX 3 /* bytes for 16 bits */
+
+/* The space for a record of n values in the worst case */
+#define ARCHIVE_RECORD_MAX(n) ((n) * ARCHIVE_VARINT_MAX)
+
+// ARCHIVE_VALUES, the values of a record, comes from bld/Makefile.options;
+// the blocks are by default the smallest that hold any record
+#ifndef ARCHIVE_BLOCK_SIZE
+#define ARCHIVE_BLOCK_SIZE (ARCHIVE_HDR_SIZE + ARCHIVE_RECORD_MAX(ARCHIVE_VALUES))
+#endif
+#ifndef ARCHIVE_BLOCKS
+#define ARCHIVE_BLOCKS 64
+#endif
+
+#if ARCHIVE_BLOCK_SIZE > 255
+#error ARCHIVE_BLOCK_SIZE must fit the length in the header (<= 255)
+#endif
+
+/* Appends the varint of v - prev to buf, returns its length */
+static inline unsigned archive_put(uint8_t *buf, int16_t v, int16_t prev)
+{
+    uint16_t d = (uint16_t)v - (uint16_t)prev;
+    uint16_t z = (uint16_t)(d << 1) ^ (uint16_t)-(d >> 15);
+    unsigned n = 0;
+    while (z >= 0x80) {
+        buf[n++] = (z & 0x7f) | 0x80;
+        z >>= 7;
+    }
+    buf[n++] = z;
+    return n;
+}
+
+/* Reads a varint from buf into *v (relative to prev), returns its length,
+   or 0 if it does not end within len bytes */
+static inline unsigned archive_get(const uint8_t *buf, unsigned len, int16_t prev, int16_t *v)
+{
+    uint16_t z = 0;
+    for (unsigned n = 0; n < len && n < ARCHIVE_VARINT_MAX; ++n) {
+        z |= (uint16_t)(buf[n] & 0x7f) << (7 * n);
+        if (!(buf[n] & 0x80)) {
+            uint16_t d = (z >> 1) ^ (uint16_t)-(z & 1);
+            *v = (int16_t)((uint16_t)prev + d);
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+static inline uint16_t archive_block_seq(const uint8_t *block)
+{
+    return block[0] | (block[1] << 8);
+}
+
+#if (ARCHIVE_BLOCKS & (ARCHIVE_BLOCKS - 1)) || ARCHIVE_BLOCKS < 4
+#error ARCHIVE_BLOCKS must be a power of two, at least 4
+#endif
+
+// State of the archive, kept in a channel by the task that appends to it,
+// with the previous record of the block (the reference for the deltas).
+// Blocks are numbered from 0 on, modulo 2^16, and are in the ring at their
+// number modulo ARCHIVE_BLOCKS. The complete blocks that can be read are
+// up to ARCHIVE_BLOCKS - 2 before the current one: the one after those, the
+// oldest, is the next one to be overwritten, possibly already in part by an
+// append that was cut short by a power failure.
+typedef struct {
+    uint16_t seq;     /* of the next record */
+    uint16_t block;   /* the block being filled */
+    uint8_t used;     /* bytes of it used, 0 if not started */
+    uint8_t full;     /* complete blocks that can be read */
+    uint8_t served;   /* the last request served (see archive_request) */
+} archive_t;
+
+/* Appends a record of n values (last: the previous one in the block, which
+   becomes this one). Only the bytes after the ones that *a counts as used
+   are written, so an append re-executed with the same state writes the
+   same bytes again. */
+void archive_append(archive_t *a, int16_t *last, const int16_t *values, unsigned n);
+
+/* Moves *next, the block to downlink next, to the oldest one that can be
+   read if it is older, or to the one that a new request asks for (see
+   archive_request); returns whether it is complete, i.e. can be sent */
+bool archive_next(archive_t *a, uint16_t *next);
+
+/* The contents of a block, ARCHIVE_BLOCK_SIZE bytes */
+const uint8_t *archive_block(uint16_t block);
+
+/* Request from the ground (e.g. from an uplink command handler, in an
+   interrupt): downlink the archive again from the block that holds the
+   record with sequence number seq (or from the oldest one) */
+void archive_request(uint16_t seq);
+
+#endif // ARCHIVE_H
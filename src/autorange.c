@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libio/console.h>
+
+#include "autorange.h"
+#include "i2c.h"
+
+#define MAG_RAW_MAX 2047
+#define LSM_RAW_MAX 32767
+#define NEAR_FULL(max) ((max) - (max) / 8)
+
+// Q8 multipliers from the LSB at each gain setting to the LSB at gain 1
+// (gains: 1370, 1090, 820, 660, 440, 390, 330, 230 LSB/Ga)
+static const uint16_t mag_mult[AUTORANGE_MAG_RANGES] = {
+  204, 256, 340, 423, 634, 716, 846, 1213,
+};
+
+static inline unsigned absu(int v)
+{
+  return v < 0 ? -(unsigned)v : (unsigned)v;
+}
+
+static unsigned mag_fs(unsigned g)
+{
+  return ((uint32_t)MAG_RAW_MAX * mag_mult[g]) >> 8;
+}
+
+/* Returns whether the range changed. lower_fs is the normalized full scale
+ * of the range below the current one. */
+static bool step(autorange_ctl_t *c, unsigned nranges, unsigned peak, bool full, unsigned lower_fs)
+{
+  if (peak > c->peak)
+    c->peak = peak;
+
+  if (full && c->range + 1u < nranges) {
+    c->range++;
+    c->peak = 0;
+    c->count = 0;
+    return true;
+  }
+
+  if (++c->count >= AUTORANGE_HOLD) {
+    bool down = c->range > 0 && c->peak < lower_fs / 2;
+    c->peak = 0;
+    c->count = 0;
+    if (down) {
+      c->range--;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Initial state: the ranges set by magnetometer_init() and lsm_init() */
+void autorange_init(autorange_t *ar)
+{
+  ar->mag = (autorange_ctl_t){ AUTORANGE_MAG_DEFAULT, 0, 0 };
+  ar->accel = (autorange_ctl_t){ 0, 0, 0 };
+  ar->gyro = (autorange_ctl_t){ 0, 0, 0 };
+  ar->mag_used = AUTORANGE_MAG_DEFAULT;
+}
+
+/* Bring the sensors to the committed ranges (on the first sample after a
+ * boot, which is after their init). mag_warm: the magnetometer skipped
+ * init, so its gain is not the default. The ranges are written anyway, in
+ * case a reboot cut a change short or rolled it back (then one more
+ * reading is taken at the gain in the sensor, and misnormalized). */
+void autorange_resume(autorange_t *ar, bool mag_ok, bool lsm_ok, bool mag_warm)
+{
+  ar->mag_used = mag_warm ? ar->mag.range : AUTORANGE_MAG_DEFAULT;
+  if (mag_ok && (mag_warm || ar->mag.range != AUTORANGE_MAG_DEFAULT))
+    magnetometer_set_gain(MAGNETOMETER_GAIN(ar->mag.range));
+
+  if (lsm_ok)
+    lsm_set_range(ar->accel.range, ar->gyro.range);
+}
+
+/* Range code for the readings that are about to be taken */
+uint8_t autorange_code(const autorange_t *ar)
+{
+  return PKT_RANGE_CODE(ar->mag_used, ar->accel.range, ar->gyro.range);
+}
+
+/* Normalize a magnetometer reading in place, and adjust the gain */
+void autorange_mag(autorange_t *ar, magnet_t *m)
+{
+  int *v[] = { &m->x, &m->y, &m->z };
+  unsigned g = ar->mag_used;
+  unsigned peak = 0;
+  bool full = false;
+
+  for (unsigned i = 0; i < sizeof(v) / sizeof(v[0]); ++i) {
+    if (*v[i] == MAGNETOMETER_OVERFLOW) {
+      full = true;
+      continue;
+    }
+    if (absu(*v[i]) >= NEAR_FULL(MAG_RAW_MAX))
+      full = true;
+
+    int n = ((int32_t)*v[i] * mag_mult[g]) >> 8;
+    if (n == MAGNETOMETER_OVERFLOW)
+      n++; // reserved
+    *v[i] = n;
+
+    if (absu(n) > peak)
+      peak = absu(n);
+  }
+
+  ar->mag_used = ar->mag.range;
+
+  // Readings taken at the old gain say nothing about the new one
+  if (g != ar->mag.range)
+    return;
+
+  if (step(&ar->mag, AUTORANGE_MAG_RANGES, peak, full, g > 0 ? mag_fs(g - 1) : 0)) {
+    LOG("[autorange] mag gain %u\r\n", ar->mag.range);
+    // On failure, stay at the old gain: the controller tries again later
+    if (magnetometer_set_gain(MAGNETOMETER_GAIN(ar->mag.range)) != I2C_OK)
+      ar->mag.range = g;
+  }
+}
+
+static unsigned lsm_norm(int *v, unsigned shift, bool *full)
+{
+  if (absu(*v) >= NEAR_FULL(LSM_RAW_MAX))
+    *full = true;
+  *v >>= shift;
+  return absu(*v);
+}
+
+/* Normalize an LSM reading in place, and adjust the full scales */
+void autorange_lsm(autorange_t *ar, lsm_t *s)
+{
+  unsigned r, peak;
+  bool full;
+  bool changed = false;
+  uint8_t accel_old = ar->accel.range;
+  uint8_t gyro_old = ar->gyro.range;
+
+  r = ar->accel.range;
+  full = false;
+  unsigned shift = AUTORANGE_ACCEL_NORM_SHIFT - r;
+  unsigned ax = lsm_norm(&s->ax, shift, &full);
+  unsigned ay = lsm_norm(&s->ay, shift, &full);
+  unsigned az = lsm_norm(&s->az, shift, &full);
+  peak = ax > ay ? ax : ay;
+  peak = peak > az ? peak : az;
+  changed |= step(&ar->accel, LSM_ACCEL_RANGES, peak, full,
+                  r > 0 ? LSM_RAW_MAX >> (shift + 1) : 0);
+
+#ifdef ENABLE_GYRO
+  r = ar->gyro.range;
+  full = false;
+  shift = AUTORANGE_GYRO_NORM_SHIFT - r;
+  unsigned gx = lsm_norm(&s->gx, shift, &full);
+  unsigned gy = lsm_norm(&s->gy, shift, &full);
+  unsigned gz = lsm_norm(&s->gz, shift, &full);
+  peak = gx > gy ? gx : gy;
+  peak = peak > gz ? peak : gz;
+  changed |= step(&ar->gyro, LSM_GYRO_RANGES, peak, full,
+                  r > 0 ? LSM_RAW_MAX >> (shift + 1) : 0);
+#endif // ENABLE_GYRO
+
+  if (changed) {
+    LOG("[autorange] accel %u gyro %u\r\n", ar->accel.range, ar->gyro.range);
+    // On failure, go back to the old ranges (either one may have changed)
+    if (lsm_set_range(ar->accel.range, ar->gyro.range) != I2C_OK) {
+      ar->accel.range = accel_old;
+      ar->gyro.range = gyro_old;
+      lsm_set_range(accel_old, gyro_old);
+    }
+  }
+}
+
+/* Range code of a window: the largest range of each sensor */
+uint8_t autorange_merge(uint8_t a, uint8_t b)
+{
+  unsigned mag = PKT_RANGE_MAG(a) > PKT_RANGE_MAG(b) ? PKT_RANGE_MAG(a) : PKT_RANGE_MAG(b);
+  unsigned accel = PKT_RANGE_ACCEL(a) > PKT_RANGE_ACCEL(b) ? PKT_RANGE_ACCEL(a) : PKT_RANGE_ACCEL(b);
+  unsigned gyro = PKT_RANGE_GYRO(a) > PKT_RANGE_GYRO(b) ? PKT_RANGE_GYRO(a) : PKT_RANGE_GYRO(b);
+  return PKT_RANGE_CODE(mag, accel, gyro);
+}
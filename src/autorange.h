@@ -0,0 +1,66 @@
+#ifndef AUTORANGE_H
+#define AUTORANGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pkt.h"
+#include "magnetometer.h"
+#include "lsm.h"
+
+// Automatic ranging of the magnetometer gain and of the LSM full scale.
+//
+// Readings are normalized at sample time to units that don't depend on the
+// range, so that averages across a range change remain meaningful:
+//     mag:   LSB at gain 1 (1090 LSB/Ga), up to SAMP_BITS_MAG bits
+//     accel: LSB at +-16 g
+//     gyro:  LSB at +-2000 dps
+// Each sample carries the range code (see pkt.h) it was taken at, a window
+// carries the largest range of each sensor over its samples, and the
+// packing stage downsamples by the factor of that range, so the packed
+// fields span the range in use instead of the widest one.
+//
+// Controller: a sensor goes up one range as soon as a reading gets within
+// 1/8 of full scale (or overflows), and down one range when the peak over
+// AUTORANGE_HOLD samples would fit in half of the lower range.
+//
+// The state of the controller belongs to the caller, which keeps it in a
+// channel (the self channel of task_sample), so that a re-executed task
+// starts over from the state it committed last. The sensor registers are
+// not rolled back with it: autorange_resume() writes the committed ranges
+// after each boot.
+
+#ifndef AUTORANGE_HOLD
+#define AUTORANGE_HOLD 32
+#endif
+
+#define AUTORANGE_MAG_RANGES 8
+#define AUTORANGE_MAG_DEFAULT 1 // as set by magnetometer_init()
+
+// Normalized = raw >> (NORM_SHIFT - range)
+#define AUTORANGE_ACCEL_NORM_SHIFT (LSM_ACCEL_RANGES - 1)
+#define AUTORANGE_GYRO_NORM_SHIFT  (LSM_GYRO_RANGES - 1)
+
+typedef struct {
+  uint8_t range;  // set in the sensor
+  unsigned peak;  // largest normalized magnitude since the last decision
+  unsigned count; // samples since the last decision
+} autorange_ctl_t;
+
+typedef struct {
+  autorange_ctl_t mag;
+  autorange_ctl_t accel;
+  autorange_ctl_t gyro;
+  // The magnetometer makes one more measurement at the old gain after a
+  // change, so keep track of the gain of the next one separately
+  uint8_t mag_used;
+} autorange_t;
+
+void autorange_init(autorange_t *ar);
+void autorange_resume(autorange_t *ar, bool mag_ok, bool lsm_ok, bool mag_warm);
+uint8_t autorange_code(const autorange_t *ar);
+void autorange_mag(autorange_t *ar, magnet_t *m);
+void autorange_lsm(autorange_t *ar, lsm_t *s);
+uint8_t autorange_merge(uint8_t a, uint8_t b);
+
+#endif // AUTORANGE_H
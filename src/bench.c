@@ -0,0 +1,95 @@
+#include <msp430.h>
+#include <stdint.h>
+
+#include <libio/console.h>
+
+#include "bench.h"
+
+// Not static: the simulator dumps it at bench_done
+bench_stat_t bench_results[BENCH_NUM];
+
+static volatile uint16_t now_hi;
+
+static int task_cur = -1;
+static uint32_t task_start;
+
+// Timer B0 (the A timers are the sleep timer and the sample clock),
+// continuous mode, on SMCLK, with the overflow interrupt
+void bench_init(void)
+{
+  for (unsigned i = 0; i < BENCH_NUM; ++i) {
+    bench_results[i].count = 0;
+    bench_results[i].total = 0;
+    bench_results[i].min = UINT32_MAX;
+    bench_results[i].max = 0;
+  }
+
+  now_hi = 0;
+  TB0CTL = TBSSEL__SMCLK | MC__CONTINUOUS | TBCLR | TBIE;
+}
+
+uint32_t bench_now(void)
+{
+  uint16_t hi, lo;
+  do { // an overflow between the reads would tear the value
+    hi = now_hi;
+    lo = TB0R;
+  } while (hi != now_hi);
+  return ((uint32_t)hi << 16) | lo;
+}
+
+void bench_add(unsigned id, uint32_t cycles)
+{
+  bench_stat_t *s = &bench_results[id];
+  s->count++;
+  s->total += cycles;
+  if (cycles < s->min)
+    s->min = cycles;
+  if (cycles > s->max)
+    s->max = cycles;
+}
+
+/* Entry into a task: charge the previous one */
+void bench_task(unsigned id)
+{
+  uint32_t t = bench_now();
+  if (task_cur >= 0)
+    bench_add(task_cur, t - task_start);
+  task_cur = id;
+  task_start = t;
+}
+
+/* End of a packet: stop after BENCH_ITERATIONS of them */
+void bench_packet(void)
+{
+  static unsigned packets;
+  if (++packets == BENCH_ITERATIONS)
+    bench_done();
+}
+
+/* The end of the run: the simulator stops here (a breakpoint) to dump the
+ * results, and on the board they go to the console */
+__attribute__ ((noinline))
+void bench_done(void)
+{
+  bench_task(task_cur); // charge the last task, i.e. task_send
+  TB0CTL &= ~MC__CONTINUOUS;
+
+  LOG("bench: point count min avg max\r\n");
+  for (unsigned i = 0; i < BENCH_NUM; ++i) {
+    bench_stat_t *s = &bench_results[i];
+    if (s->count == 0)
+      continue;
+    LOG("bench: %s %lu %lu %lu %lu\r\n", bench_name(i), s->count,
+        s->min, s->total / s->count, s->max);
+  }
+
+  while (1);
+}
+
+__attribute__ ((interrupt(TIMER0_B1_VECTOR)))
+void TIMER0_B1_ISR(void)
+{
+  if (TB0IV == TB0IV_TBIFG)
+    ++now_hi;
+}
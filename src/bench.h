@@ -0,0 +1,95 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+// Cycle counts of the tasks and of selected kernels (ENABLE_BENCH).
+//
+// Timer_B0 counts SMCLK (= MCLK, undivided), extended to 32 bits by its
+// overflow interrupt, so the same build measures on the board and in an
+// instruction-set simulator that models the timer (bld/bench).
+//
+// A task is charged the cycles from its entry to the entry of the next
+// task, i.e. including its channel accesses and its transition. A kernel
+// is charged the cycles between BENCH_BEGIN and BENCH_END around it; the
+// 'empty' point is a pair with nothing in between, i.e. the overhead that
+// every other kernel count includes.
+//
+// The table of points below is shared with tools/benchtab, which prints
+// bench_results from a memory dump. Points that never ran are skipped.
+// The points before 'empty' are the tasks, the rest are kernels.
+
+#define BENCH_POINTS(X) \
+    X(task_init) \
+    X(task_sample) \
+    X(task_window) \
+    X(task_update_window_start) \
+    X(task_update_window) \
+    X(task_output) \
+    X(task_pack) \
+    X(task_send) \
+    X(task_spectrum) \
+    X(task_spectrum_peaks) \
+    X(task_schedule) \
+    X(task_archive) \
+    X(empty) \
+    X(stat_window) \
+    X(scale_sample) \
+    X(win_pack) \
+    X(win_unpack) \
+    X(stats_pack) \
+    X(link_frame) \
+    X(spectrum_step) \
+    X(spectrum_power) \
+    X(chan_in_sample) \
+    X(chan_out_sample) \
+
+#define BENCH_ID(name) BENCH_ ## name,
+enum { BENCH_POINTS(BENCH_ID) BENCH_NUM };
+
+// All fields are 32 bits, so the layout is the same on the host
+typedef struct {
+    uint32_t count;
+    uint32_t total;
+    uint32_t min;
+    uint32_t max;
+} bench_stat_t;
+
+#define BENCH_NAME(name) #name,
+static inline const char *bench_name(unsigned id)
+{
+    static const char *const tab[BENCH_NUM] = { BENCH_POINTS(BENCH_NAME) };
+    return tab[id];
+}
+
+#ifdef ENABLE_BENCH
+
+// Packets to run through the chain before stopping in bench_done()
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 16
+#endif
+
+extern bench_stat_t bench_results[BENCH_NUM];
+
+void bench_init(void);
+uint32_t bench_now(void);
+void bench_add(unsigned id, uint32_t cycles);
+void bench_task(unsigned id);
+void bench_packet(void);
+void bench_done(void);
+
+#define BENCH_TASK(name) bench_task(BENCH_ ## name)
+#define BENCH_BEGIN(name) uint32_t bench_t0_ ## name = bench_now()
+#define BENCH_END(name) bench_add(BENCH_ ## name, bench_now() - bench_t0_ ## name)
+#define BENCH_PACKET() bench_packet()
+
+#else // !ENABLE_BENCH
+
+#define BENCH_TASK(name)
+#define BENCH_BEGIN(name)
+#define BENCH_END(name)
+#define BENCH_PACKET()
+
+#endif // !ENABLE_BENCH
+
+#endif // BENCH_H
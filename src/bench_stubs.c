@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libmspuartlink/uartlink.h>
+
+#include "temp_sensor.h"
+#include "magnetometer.h"
+#include "lsm.h"
+#include "i2c.h"
+#include "energy.h"
+
+// Stand-ins for the sensors, the radio UART and the energy monitor in the
+// bench build, which runs where there is no I2C slave, nobody drains the
+// UART and there is no harvester (so the energy is always high). The readings
+// are synthetic but deterministic, so runs are comparable: a slow ramp plus
+// noise, and square waves on the accelerometer for the spectral stage.
+// They are cheap (masks, no division), since task_sample is charged for
+// them.
+
+static uint16_t seed = 1;
+static unsigned n;
+
+/* Noise in [-range/2, range/2) (range a power of two), from an LCG */
+static int noise(unsigned range)
+{
+  seed = seed * 25173 + 13849;
+  return (int)((seed >> 8) & (range - 1)) - (int)(range / 2);
+}
+
+/* Square wave with the given period (a power of two) in samples */
+static int tone(unsigned period, int amp)
+{
+  return (n & (period / 2)) ? amp : -amp;
+}
+
+void i2c_setup(void)
+{
+}
+
+signed short read_temperature_sensor()
+{
+  return 20 + (n >> 6) % 4;
+}
+
+void init_temp_sensor()
+{
+}
+
+bool magnetometer_init(void)
+{
+  return true;
+}
+
+bool magnetometer_check(void)
+{
+  return true;
+}
+
+int magnetometer_read(magnet_t *coordinates)
+{
+  coordinates->x = 200 + (int)(n % 64) + noise(16);
+  coordinates->y = -100 + noise(16);
+  coordinates->z = 400 - (int)(n % 32) + noise(16);
+  return I2C_OK;
+}
+
+int magnetometer_set_gain(unsigned gain)
+{
+  (void)gain;
+  return I2C_OK;
+}
+
+bool lsm_init()
+{
+  return true;
+}
+
+bool lsm_check()
+{
+  return true;
+}
+
+int lsm_sample(lsm_t *sample)
+{
+  ++n;
+  sample->ax = tone(8, 2000) + noise(64);
+  sample->ay = noise(64);
+  sample->az = 16384 + tone(4, 500) + noise(64);
+  sample->gx = noise(32);
+  sample->gy = noise(32);
+  sample->gz = tone(16, 1000) + noise(32);
+  return I2C_OK;
+}
+
+int lsm_set_range(unsigned accel, unsigned gyro)
+{
+  (void)accel;
+  (void)gyro;
+  return I2C_OK;
+}
+
+int lsm_set_odr(unsigned odr)
+{
+  (void)odr;
+  return I2C_OK;
+}
+
+void uartlink_open_tx(void)
+{
+}
+
+void uartlink_send(uint8_t *payload, unsigned len)
+{
+  (void)payload;
+  (void)len;
+}
+
+void uartlink_close(void)
+{
+}
+
+void energy_init(void)
+{
+}
+
+bool energy_high(void)
+{
+  return true;
+}
@@ -0,0 +1,29 @@
+#include <msp430.h>
+#include <stdbool.h>
+
+#include "energy.h"
+
+// Input ENERGY_COMP_CHAN on the + terminal, the ladder on the - one, so
+// that CEOUT is 1 while the voltage is over the threshold. The ladder tap
+// follows CEOUT: CEREF1 while it is 1 (the threshold), CEREF0 while it is
+// 0 (the threshold plus the hysteresis). Ultra-low power mode: the
+// comparator stays on all the time, and a slow response is good enough.
+void energy_init(void)
+{
+  CEINT = 0;
+  CECTL0 = CEIPEN | ENERGY_COMP_CHAN;
+  CECTL2 = CEREFL_1 | CERS_2 | CERSEL |
+           ((unsigned)ENERGY_COMP_REF << 8) | (ENERGY_COMP_REF + ENERGY_COMP_HYST);
+  CECTL3 = 1u << ENERGY_COMP_CHAN; // analog input, digital buffer off
+  CECTL1 = CEON | CEPWRMD_2 | CEF | CEFDLY_3 | CEIES; // CEIFG on a falling edge
+  while (!(CEINT & CERDYIFG))
+    ; // the reference settles
+  CEINT &= ~(CEIFG | CEIIFG | CERDYIFG);
+}
+
+bool energy_high(void)
+{
+  bool dipped = CEINT & CEIFG;
+  CEINT &= ~CEIFG;
+  return !dipped && (CECTL1 & CEOUT);
+}
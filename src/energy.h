@@ -0,0 +1,45 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdbool.h>
+
+// Energy monitor on the harvester comparator (COMP_E): the capacitor
+// voltage, through the divider on input ENERGY_COMP_CHAN, against tap
+// ENERGY_COMP_REF (of 32) of the ladder on the 1.2 V reference, as
+// libharvest wires it (LIBHARVEST_COMP_*). Once the harvester has charged
+// the capacitor, the energy is high until the voltage drops under the
+// threshold, and low until it is back over the threshold plus
+// ENERGY_COMP_HYST taps. A dip under the threshold in between two looks
+// counts as low once: the comparator latches it in its interrupt flag
+// (CEIFG), which is polled rather than serviced, since the vector belongs
+// to libharvest and the app can only act on it at a task boundary anyway.
+//
+// The app uses it to make its tasks larger while there is energy to spare
+// (fewer transitions, so fewer commits of the channels), and to go back to
+// small tasks, each committed at its end, as soon as the energy is low
+// (ENABLE_JIT_COALESCE, see CASCADE_COALESCE in main.c).
+
+#ifndef ENERGY_COMP_CHAN
+#define ENERGY_COMP_CHAN 11
+#endif
+
+#ifndef ENERGY_COMP_REF
+#define ENERGY_COMP_REF 23
+#endif
+
+#ifndef ENERGY_COMP_HYST
+#define ENERGY_COMP_HYST 1
+#endif
+
+#if ENERGY_COMP_CHAN > 15 || ENERGY_COMP_REF + ENERGY_COMP_HYST > 31
+#error ENERGY_COMP_CHAN must be 0-15, ENERGY_COMP_REF + ENERGY_COMP_HYST at most 31
+#endif
+
+/* Start monitoring (on boot, after harvest_charge) */
+void energy_init(void);
+
+/* Whether the energy is high now, and was since the last call (a couple of
+   register reads) */
+bool energy_high(void);
+
+#endif // ENERGY_H
@@ -0,0 +1,222 @@
+#include <msp430.h>
+#include <libmspware/driverlib.h>
+#include <libio/console.h>
+
+#include "i2c.h"
+
+#define PIN_SDA BIT6 /* P1.6: UCB0SDA */
+#define PIN_SCL BIT7 /* P1.7: UCB0SCL */
+
+#define HALF_PERIOD_CYCLES 10 /* of SCL at 100 kHz, for MCLK up to 2 MHz */
+#define RECOVER_CLOCKS 9      /* a byte and its ACK */
+
+void i2c_setup(void) {
+  /*
+  * Select Port 1
+  * Set Pin 6, 7 to input Secondary Module Function:
+  *   (UCB0SIMO/UCB0SDA, UCB0SOMI/UCB0SCL)
+  */
+
+
+  GPIO_setAsPeripheralModuleFunctionInputPin(
+    GPIO_PORT_P1,
+    GPIO_PIN6 + GPIO_PIN7,
+    GPIO_SECONDARY_MODULE_FUNCTION
+  );
+
+
+
+  EUSCI_B_I2C_initMasterParam param = {0};
+  param.selectClockSource = EUSCI_B_I2C_CLOCKSOURCE_SMCLK;
+  param.i2cClk = CS_getSMCLK();
+  param.dataRate = EUSCI_B_I2C_SET_DATA_RATE_100KBPS;
+  param.byteCounterThreshold = 0;
+  param.autoSTOPGeneration = EUSCI_B_I2C_NO_AUTO_STOP;
+
+  EUSCI_B_I2C_initMaster(EUSCI_B0_BASE, &param);
+
+
+}
+
+/* Wait for a flag in UCB0IFG, failing on a NACK */
+static int wait_ifg(unsigned flag)
+{
+  for (unsigned n = I2C_TIMEOUT; n > 0; --n) {
+    if (UCB0IFG & UCNACKIFG)
+      return I2C_ENACK;
+    if (UCB0IFG & flag)
+      return I2C_OK;
+  }
+  return I2C_ETIMEOUT;
+}
+
+/* Wait for the address transmission to finish, failing on a NACK */
+static int wait_start(void)
+{
+  for (unsigned n = I2C_TIMEOUT; n > 0; --n) {
+    if (UCB0IFG & UCNACKIFG)
+      return I2C_ENACK;
+    if (!(UCB0CTLW0 & UCTXSTT))
+      return I2C_OK;
+  }
+  return I2C_ETIMEOUT;
+}
+
+/* Wait for the bus to be free (after our STOP, or someone else's) */
+static int wait_idle(void)
+{
+  for (unsigned n = I2C_TIMEOUT; n > 0; --n) {
+    if (!(UCB0STATW & UCBBUSY))
+      return I2C_OK;
+  }
+  return I2C_ETIMEOUT;
+}
+
+/* Leave the bus usable after a failed transaction */
+static int fail(int err)
+{
+  if (err == I2C_ENACK) {
+    UCB0CTLW0 |= UCTXSTP;
+    UCB0IFG &= ~UCNACKIFG;
+    if (wait_idle() == I2C_OK)
+      return err;
+  }
+  i2c_recover();
+  return err;
+}
+
+/* Address the slave, once the bus is free */
+static int begin(uint8_t addr)
+{
+  UCB0CTLW0 |= UCSWRST; // disable
+  UCB0I2CSA = addr;
+  UCB0CTLW0 &= ~UCSWRST; // enable
+
+  if (wait_idle() == I2C_OK)
+    return I2C_OK;
+  i2c_recover();
+  return wait_idle() == I2C_OK ? I2C_OK : I2C_EBUS;
+}
+
+/* Send the register address, after a start in transmit mode */
+static int send_reg(uint8_t reg)
+{
+  UCB0CTLW0 |= UCTR | UCTXSTT; // transmit mode and start
+
+  // Have to wait for addr transmission to finish, otherwise the TXIFG does not
+  // behave as expected (the writes that follow fall through, despite waits on
+  // TXIFG).
+  int rc = wait_start();
+  if (rc == I2C_OK)
+    rc = wait_ifg(UCTXIFG);
+  if (rc == I2C_OK) {
+    UCB0TXBUF = reg;
+    rc = wait_ifg(UCTXIFG);
+  }
+  return rc;
+}
+
+/* Receive len bytes, with a (repeated) start in receive mode */
+static int receive(uint8_t *buf, unsigned len)
+{
+  UCB0CTLW0 &= ~UCTR; // receive mode
+  UCB0CTLW0 |= UCTXSTT; // (repeated) start
+
+  // wait for addr transmission to finish, data transfer to start
+  int rc = wait_start();
+
+  for (unsigned i = 0; i < len && rc == I2C_OK; ++i) {
+    if (i == len - 1)
+      UCB0CTLW0 |= UCTXSTP; // stop
+
+    rc = wait_ifg(UCRXIFG);
+    if (rc == I2C_OK)
+      buf[i] = UCB0RXBUF;
+  }
+
+  if (rc == I2C_OK)
+    rc = wait_idle();
+  return rc;
+}
+
+int i2c_write_reg(uint8_t addr, uint8_t reg, uint8_t val)
+{
+  int rc = begin(addr);
+  if (rc != I2C_OK)
+    return rc;
+
+  rc = send_reg(reg);
+  if (rc == I2C_OK) {
+    UCB0TXBUF = val;
+    rc = wait_ifg(UCTXIFG);
+  }
+  if (rc == I2C_OK) {
+    UCB0CTLW0 |= UCTXSTP; // stop
+    rc = wait_idle();
+  }
+  if (rc != I2C_OK)
+    return fail(rc);
+
+  // The value is acked after it left the buffer, i.e. after the last wait
+  if (UCB0IFG & UCNACKIFG) {
+    UCB0IFG &= ~UCNACKIFG;
+    return I2C_ENACK;
+  }
+  return I2C_OK;
+}
+
+int i2c_read_regs(uint8_t addr, uint8_t reg, uint8_t *buf, unsigned len)
+{
+  int rc = begin(addr);
+  if (rc != I2C_OK)
+    return rc;
+
+  rc = send_reg(reg);
+  if (rc == I2C_OK)
+    rc = receive(buf, len);
+  return rc == I2C_OK ? rc : fail(rc);
+}
+
+/* Read from the current register of the slave (e.g. auto-incremented) */
+int i2c_read(uint8_t addr, uint8_t *buf, unsigned len)
+{
+  int rc = begin(addr);
+  if (rc != I2C_OK)
+    return rc;
+
+  rc = receive(buf, len);
+  return rc == I2C_OK ? rc : fail(rc);
+}
+
+/* Bus recovery: toggle SCL by hand until SDA is released (at most one byte
+ * and its ACK), then generate a STOP (SDA rises while SCL is high). */
+void i2c_recover(void)
+{
+  UCB0CTLW0 |= UCSWRST;
+
+  // The pins as GPIO, open drain: low when an output, else pulled up
+  P1OUT &= ~(PIN_SDA | PIN_SCL);
+  P1DIR &= ~(PIN_SDA | PIN_SCL);
+  P1SEL1 &= ~(PIN_SDA | PIN_SCL);
+
+  for (unsigned i = 0; i < RECOVER_CLOCKS && !(P1IN & PIN_SDA); ++i) {
+    P1DIR |= PIN_SCL;
+    __delay_cycles(HALF_PERIOD_CYCLES);
+    P1DIR &= ~PIN_SCL;
+    __delay_cycles(HALF_PERIOD_CYCLES);
+  }
+
+  P1DIR |= PIN_SCL;
+  __delay_cycles(HALF_PERIOD_CYCLES);
+  P1DIR |= PIN_SDA;
+  __delay_cycles(HALF_PERIOD_CYCLES);
+  P1DIR &= ~PIN_SCL;
+  __delay_cycles(HALF_PERIOD_CYCLES);
+  P1DIR &= ~PIN_SDA;
+  __delay_cycles(HALF_PERIOD_CYCLES);
+
+  P1SEL1 |= PIN_SDA | PIN_SCL; // back to the module
+  UCB0CTLW0 &= ~UCSWRST;
+
+  LOG("[i2c] bus recovery: SDA %u\r\n", (P1IN & PIN_SDA) ? 1 : 0);
+}
@@ -0,0 +1,38 @@
+#ifndef I2C_H
+#define I2C_H
+
+#include <stdint.h>
+
+// Register transactions on the I2C bus (eUSCI_B0, master), in which every
+// wait is bounded, so that a sensor that stops responding costs a bounded
+// amount of energy instead of all of it.
+//
+// Errors (negative, I2C_OK is 0):
+//   I2C_ENACK:    the slave did not acknowledge its address or a byte;
+//                 the transaction is ended with a STOP.
+//   I2C_ETIMEOUT: a flag did not come up within I2C_TIMEOUT polls (e.g.
+//                 the slave holds SCL); the bus is recovered.
+//   I2C_EBUS:     the bus stays busy even after recovery.
+//
+// Recovery resets the module and clocks SCL by hand until a slave that
+// holds SDA low (e.g. because it was cut off in the middle of a byte)
+// releases it, then sends a STOP.
+
+#define I2C_OK        0
+#define I2C_ENACK    -1
+#define I2C_ETIMEOUT -2
+#define I2C_EBUS     -3
+
+// Polls of a status flag before giving up: ~10 ms at 1 MHz, vs. ~100 us
+// for a byte at 100 kHz, which leaves room for clock stretching
+#ifndef I2C_TIMEOUT
+#define I2C_TIMEOUT 1000
+#endif
+
+void i2c_setup(void);
+int i2c_write_reg(uint8_t addr, uint8_t reg, uint8_t val);
+int i2c_read_regs(uint8_t addr, uint8_t reg, uint8_t *buf, unsigned len);
+int i2c_read(uint8_t addr, uint8_t *buf, unsigned len);
+void i2c_recover(void);
+
+#endif // I2C_H
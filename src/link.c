@@ -0,0 +1,42 @@
+#include <msp430.h>
+#include <stdint.h>
+
+#include "link.h"
+
+// CRC16 module: bytes written to CRCDIRB are processed MSB first, which
+// together with the result in CRCINIRES gives the standard CRC-16-CCITT
+// (same as link_crc16_sw), without a table or a bit loop on the CPU.
+uint16_t link_crc16(const uint8_t *data, unsigned len)
+{
+  CRCINIRES = LINK_CRC_INIT;
+  for (unsigned i = 0; i < len; ++i)
+    CRCDIRB_L = data[i];
+  return CRCINIRES;
+}
+
+// Build the frame for the payload into the given buffer, which must hold
+// LINK_FRAME_SIZE(len) bytes. Returns the length of the frame.
+unsigned link_frame(uint8_t *frame, const uint8_t *payload, unsigned len)
+{
+#ifdef ENABLE_LINK_FEC
+  uint8_t raw[LINK_RAW_SIZE(len, LINK_CRC)];
+#else // !ENABLE_LINK_FEC
+  uint8_t *raw = frame;
+#endif // !ENABLE_LINK_FEC
+  unsigned raw_len = len;
+
+  for (unsigned i = 0; i < len; ++i)
+    raw[i] = payload[i];
+
+#ifdef ENABLE_LINK_CRC
+  uint16_t crc = link_crc16(payload, len);
+  raw[raw_len++] = crc & 0xff;
+  raw[raw_len++] = crc >> 8;
+#endif // ENABLE_LINK_CRC
+
+#ifdef ENABLE_LINK_FEC
+  return link_fec_encode(frame, raw, raw_len);
+#else // !ENABLE_LINK_FEC
+  return raw_len;
+#endif // !ENABLE_LINK_FEC
+}
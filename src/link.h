@@ -0,0 +1,147 @@
+#ifndef LINK_H
+#define LINK_H
+
+// Framing for packets sent over the radio link (via uartlink).
+//
+//   frame = FEC( payload | CRC16 )
+//
+// Both stages are optional (ENABLE_LINK_CRC, ENABLE_LINK_FEC):
+//
+// CRC: CRC-16-CCITT (poly 0x1021, init 0xffff, MSB-first, no final xor),
+//      appended LSB first. On the MCU it is computed by the CRC16 module.
+//
+// FEC: each byte is split into two nibbles (low first), each nibble is
+//      encoded into an extended Hamming(8,4) codeword (corrects 1 error,
+//      detects 2), and each block of 8 codewords is bit-interleaved, so that
+//      byte k of the block carries bit k of every codeword. One corrupted
+//      byte on the wire costs at most one bit per codeword, which is always
+//      corrected. The input is zero-padded to a whole block.
+//
+// Everything here except link_frame() is portable, so that host tools
+// decode with the same code.
+
+#include <stdint.h>
+
+#define LINK_CRC_INIT 0xffff
+#define LINK_CRC_SIZE 2
+
+#define LINK_FEC_BLOCK 4 /* data bytes per interleaved block of 8 codewords */
+#define LINK_FEC_BLOCK_CODED (LINK_FEC_BLOCK * 2)
+
+#define LINK_RAW_SIZE(len, crc) ((len) + ((crc) ? LINK_CRC_SIZE : 0))
+#define LINK_FEC_SIZE(len) \
+    (((len) + LINK_FEC_BLOCK - 1) / LINK_FEC_BLOCK * LINK_FEC_BLOCK_CODED)
+
+#ifdef ENABLE_LINK_CRC
+#define LINK_CRC 1
+#else
+#define LINK_CRC 0
+#endif
+
+#if defined(ENABLE_LINK_CRC) || defined(ENABLE_LINK_FEC)
+#define LINK_FRAMING
+#endif
+
+#ifdef ENABLE_LINK_FEC
+#define LINK_FRAME_SIZE(len) LINK_FEC_SIZE(LINK_RAW_SIZE(len, LINK_CRC))
+#else
+#define LINK_FRAME_SIZE(len) LINK_RAW_SIZE(len, LINK_CRC)
+#endif
+
+typedef struct {
+    unsigned corrected;     /* codewords with a corrected bit error */
+    unsigned uncorrectable; /* codewords with a detected double error */
+} link_fec_stats_t;
+
+/* Reference implementation of the CRC computed by the CRC16 module */
+static inline uint16_t link_crc16_sw(const uint8_t *data, unsigned len)
+{
+    uint16_t crc = LINK_CRC_INIT;
+    for (unsigned i = 0; i < len; ++i) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (unsigned b = 0; b < 8; ++b)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+// Codeword bit k is Hamming position k (bit 0 is the overall parity):
+//     bit:  7  6  5  4  3  2  1  0
+//          d3 d2 d1 p4 d0 p2 p1 p0
+static const uint8_t link_hamming_tab[16] = {
+    0x00, 0x0f, 0x33, 0x3c, 0x55, 0x5a, 0x66, 0x69,
+    0x96, 0x99, 0xa5, 0xaa, 0xc3, 0xcc, 0xf0, 0xff,
+};
+
+static inline uint8_t link_hamming_decode(uint8_t cw, link_fec_stats_t *stats)
+{
+    unsigned syndrome = 0;
+    unsigned parity = 0;
+    for (unsigned k = 0; k < 8; ++k) {
+        if (cw & (1 << k)) {
+            syndrome ^= k;
+            parity ^= 1;
+        }
+    }
+
+    if (parity) { // single error, at position 'syndrome'
+        cw ^= 1 << syndrome;
+        stats->corrected++;
+    } else if (syndrome) { // double error
+        stats->uncorrectable++;
+    }
+
+    return ((cw >> 3) & 0x1) | ((cw >> 4) & 0xe);
+}
+
+/* Transpose an 8x8 bit matrix: out[k] bit j = in[j] bit k (self-inverse) */
+static inline void link_interleave(uint8_t *out, const uint8_t *in)
+{
+    for (unsigned k = 0; k < 8; ++k) {
+        uint8_t b = 0;
+        for (unsigned j = 0; j < 8; ++j)
+            b |= ((in[j] >> k) & 0x1) << j;
+        out[k] = b;
+    }
+}
+
+/* Encode len bytes, returns the coded length: LINK_FEC_SIZE(len) */
+static inline unsigned link_fec_encode(uint8_t *out, const uint8_t *in, unsigned len)
+{
+    uint8_t cw[LINK_FEC_BLOCK_CODED];
+    unsigned n = 0;
+
+    for (unsigned i = 0; i < len; i += LINK_FEC_BLOCK) {
+        for (unsigned j = 0; j < LINK_FEC_BLOCK; ++j) {
+            uint8_t b = (i + j < len) ? in[i + j] : 0;
+            cw[2 * j]     = link_hamming_tab[b & 0xf];
+            cw[2 * j + 1] = link_hamming_tab[b >> 4];
+        }
+        link_interleave(out + n, cw);
+        n += LINK_FEC_BLOCK_CODED;
+    }
+    return n;
+}
+
+/* Decode len coded bytes (a multiple of the coded block), returns the
+ * decoded length, including the padding */
+static inline unsigned link_fec_decode(uint8_t *out, const uint8_t *in, unsigned len,
+                                       link_fec_stats_t *stats)
+{
+    uint8_t cw[LINK_FEC_BLOCK_CODED];
+    unsigned n = 0;
+
+    for (unsigned i = 0; i + LINK_FEC_BLOCK_CODED <= len; i += LINK_FEC_BLOCK_CODED) {
+        link_interleave(cw, in + i);
+        for (unsigned j = 0; j < LINK_FEC_BLOCK; ++j) {
+            out[n++] = link_hamming_decode(cw[2 * j], stats) |
+                       (link_hamming_decode(cw[2 * j + 1], stats) << 4);
+        }
+    }
+    return n;
+}
+
+uint16_t link_crc16(const uint8_t *data, unsigned len);
+unsigned link_frame(uint8_t *frame, const uint8_t *payload, unsigned len);
+
+#endif // LINK_H
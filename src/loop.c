@@ -0,0 +1,257 @@
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libio/console.h>
+#include <libmsp/mem.h>
+#include <libmsp/watchdog.h>
+#include <libmsp/clock.h>
+#include <libmsp/gpio.h>
+#include <libmspuartlink/uartlink.h>
+
+#ifdef LOOP_DINO
+#include <libdino/dino.h>
+#endif // LOOP_DINO
+
+#include "i2c.h"
+#include "temp_sensor.h"
+#include "magnetometer.h"
+#include "lsm.h"
+#include "pkt.h"
+#include "link.h"
+#include "bench.h"
+
+// The app as a plain C loop, for the runtimes that make a C program
+// intermittence-safe on their own: mementos, which checkpoints the volatile
+// state, and dino (LOOP_DINO), which versions the nonvolatile state at the
+// task boundaries of the loop. It is the pipeline of the libchain tasks in
+// main.c in their base configuration (no optional stage), on the same
+// packet schema and the same sensor stubs, so that bld/compare.sh compares
+// the runtimes on the same work: each stage is charged to the bench point
+// of the task it stands for.
+
+#if defined(ENABLE_SAMPLE_CLOCK) || defined(ENABLE_WINDOW_STATS) || \
+    defined(ENABLE_EMA_CASCADE) || defined(ENABLE_TXQ) || defined(ENABLE_UART_DMA) || \
+    defined(ENABLE_MAG_CAL) || defined(ENABLE_AUTORANGE) || defined(ENABLE_POWER_MODES) || \
+    defined(ENABLE_SPECTRUM) || defined(ENABLE_DOUBLE_BUFFER) || \
+    defined(ENABLE_TX_SUPPRESS) || defined(ENABLE_LINK_BUDGET) || \
+    defined(ENABLE_ARCHIVE) || defined(ENABLE_JIT_COALESCE) || defined(ENABLE_WARM_BOOT)
+#error The plain loop implements the base configuration only (ENABLE_GYRO and the link framing aside)
+#endif
+
+/* Geometry of the cascade, as in main.c */
+#ifndef WINDOW_DIV_SHIFT
+#define WINDOW_DIV_SHIFT 2
+#define WINDOW_SIZE 4
+#define NUM_WINDOWS 4
+#define PKT_WINDOW_LEVELS 0, NUM_WINDOWS - 1
+#endif // WINDOW_DIV_SHIFT
+
+// Under mementos, the state is volatile, and the checkpoints save it; under
+// dino, it is nonvolatile, and the task boundaries version it
+#ifdef LOOP_DINO
+#define LOOP_STATE __nv
+#define LOOP_BOUNDARY() DINO_TASK_BOUNDARY(NULL)
+#else // !LOOP_DINO
+#define LOOP_STATE
+#define LOOP_BOUNDARY()
+#endif // !LOOP_DINO
+
+typedef struct {
+  int16_t v[PKT_NUM_FIELDS];
+} samp_t;
+
+static const unsigned pkt_window_indexes[] = { PKT_WINDOW_LEVELS };
+#define PKT_NUM_LEVELS (sizeof(pkt_window_indexes) / sizeof(pkt_window_indexes[0]))
+
+typedef struct {
+  uint8_t windows[PKT_NUM_LEVELS][PKT_WIN_SIZE];
+} pkt_t;
+
+static bool mag_ok;
+static bool lsm_ok;
+
+static LOOP_STATE magnet_t mag_last;
+static LOOP_STATE lsm_t lsm_last;
+
+static LOOP_STATE samp_t window[WINDOW_SIZE]; // the samples of the window being filled
+static LOOP_STATE unsigned window_i;
+static LOOP_STATE bool first_window = true;
+
+// Level k of the cascade slides over the last WINDOW_SIZE averages of
+// level k-1 (of the windows of samples, for level 0)
+static LOOP_STATE samp_t levels[NUM_WINDOWS][WINDOW_SIZE];
+static LOOP_STATE unsigned level_i[NUM_WINDOWS];
+static LOOP_STATE samp_t level_avg[NUM_WINDOWS];
+
+static LOOP_STATE pkt_t pkt;
+
+static void sample(samp_t *s)
+{
+  BENCH_TASK(task_sample);
+
+  s->v[PKT_F_temp] = read_temperature_sensor();
+
+  magnet_t mag;
+  if (mag_ok && magnetometer_read(&mag) == I2C_OK)
+    mag_last = mag;
+  s->v[PKT_F_mx] = mag_last.x;
+  s->v[PKT_F_my] = mag_last.y;
+  s->v[PKT_F_mz] = mag_last.z;
+
+  lsm_t lsm;
+  if (lsm_ok && lsm_sample(&lsm) == I2C_OK)
+    lsm_last = lsm;
+  s->v[PKT_F_ax] = lsm_last.ax;
+  s->v[PKT_F_ay] = lsm_last.ay;
+  s->v[PKT_F_az] = lsm_last.az;
+#ifdef ENABLE_GYRO
+  s->v[PKT_F_gx] = lsm_last.gx;
+  s->v[PKT_F_gy] = lsm_last.gy;
+  s->v[PKT_F_gz] = lsm_last.gz;
+#endif // ENABLE_GYRO
+}
+
+/* Puts the sample in the window; returns whether that filled it */
+static bool add_sample(const samp_t *s)
+{
+  BENCH_TASK(task_window);
+
+  window[window_i] = *s;
+  window_i = (window_i + 1) % WINDOW_SIZE;
+  if (window_i != 0)
+    return false;
+
+  // The levels start out all at the last sample of the first window
+  if (first_window) {
+    for (unsigned k = 0; k < NUM_WINDOWS; ++k)
+      for (unsigned j = 0; j < WINDOW_SIZE; ++j)
+        levels[k][j] = *s;
+    first_window = false;
+  }
+  return true;
+}
+
+static void average(samp_t *avg, const samp_t *w)
+{
+  BENCH_TASK(task_update_window_start);
+
+  for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f) {
+    long sum = 0;
+    for (unsigned j = 0; j < WINDOW_SIZE; ++j)
+      sum += w[j].v[f];
+    avg->v[f] = sum / WINDOW_SIZE;
+  }
+}
+
+static void update_level(unsigned k, const samp_t *avg)
+{
+  BENCH_TASK(task_update_window);
+
+  level_avg[k] = *avg;
+  levels[k][level_i[k]] = *avg;
+  level_i[k] = (level_i[k] + 1) % WINDOW_SIZE;
+}
+
+/* v / 2^shift, truncated toward zero like the division, but without one */
+static inline int div_pow2(int v, unsigned shift)
+{
+  return v < 0 ? -(int)(-(unsigned)v >> shift) : v >> shift;
+}
+
+/* As scale_sample in main.c */
+static void scale(pkt_win_t *win, const samp_t *s)
+{
+  for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f) {
+    int max = (1 << (pkt_field_bits(f) - 1)) - 1;
+    int min = -max - 1;
+    int v = s->v[f];
+
+    if (pkt_field_sensor(f) == PKT_SENSOR_MAG) {
+      if (v == MAGNETOMETER_OVERFLOW) {
+        win->v[f] = min;
+        continue;
+      }
+      ++min;
+    }
+
+    v = div_pow2(v, pkt_field_shift(f));
+    win->v[f] = v < min ? min : (v > max ? max : v);
+  }
+}
+
+static void pack(void)
+{
+  BENCH_TASK(task_pack);
+
+  for (unsigned i = 0; i < PKT_NUM_LEVELS; ++i) {
+    pkt_win_t win;
+    scale(&win, &level_avg[pkt_window_indexes[i]]);
+    pkt_win_pack(pkt.windows[i], &win);
+  }
+}
+
+static void send(void)
+{
+  BENCH_TASK(task_send);
+
+  uartlink_open_tx();
+#ifdef LINK_FRAMING
+  static uint8_t frame[LINK_FRAME_SIZE(sizeof(pkt_t))];
+  uartlink_send(frame, link_frame(frame, (const uint8_t *)&pkt, sizeof(pkt_t)));
+#else // !LINK_FRAMING
+  uartlink_send((uint8_t *)&pkt, sizeof(pkt_t));
+#endif // !LINK_FRAMING
+  uartlink_close();
+
+  BENCH_PACKET();
+}
+
+int main(void)
+{
+  msp_watchdog_disable();
+  msp_gpio_unlock();
+  __enable_interrupt();
+  msp_clock_setup();
+
+#ifdef ENABLE_BENCH
+  bench_init();
+  BENCH_TASK(task_init);
+#endif // ENABLE_BENCH
+
+  INIT_CONSOLE();
+  LOG("space app (loop)\r\n");
+
+  i2c_setup();
+  mag_ok = magnetometer_init();
+  lsm_ok = lsm_init();
+
+#ifdef LOOP_DINO
+  // After a power failure, go on from the last boundary
+  DINO_RESTORE_CHECK();
+#endif // LOOP_DINO
+
+  while (1) {
+    samp_t s;
+    sample(&s);
+    LOOP_BOUNDARY();
+
+    if (!add_sample(&s))
+      continue;
+    LOOP_BOUNDARY();
+
+    const samp_t *w = window;
+    for (unsigned k = 0; k < NUM_WINDOWS; ++k) {
+      samp_t avg;
+      average(&avg, w);
+      update_level(k, &avg);
+      LOOP_BOUNDARY();
+      w = levels[k];
+    }
+
+    pack();
+    LOOP_BOUNDARY();
+    send();
+    LOOP_BOUNDARY();
+  }
+}
@@ -1,8 +1,12 @@
+#include <string.h>
+
 #include <libmspware/driverlib.h>
 #include <libio/console.h>
 #include <libmsp/sleep.h>
 
 #include "lsm.h"
+#include "i2c.h"
+#include "sample_clock.h"
 
 #define LSM_SLAVE_ADDRESS 0x6b /* 1101011 */
 
@@ -14,10 +18,34 @@
 
 #define LSM_ODR_XL_12_5_HZ  0x10
 #define LSM_ODR_XL_52_HZ    0x30
+#define LSM_ODR_XL_MASK     0xf0
 
+#define LSM_ODR_G_POWER_DOWN 0x00
 #define LSM_ODR_G_52_HZ    0x30
 #define LSM_FS_125         0x02 /* minimum */
 
+// Full-scale bits, by range index (see lsm.h)
+static const uint8_t lsm_fs_xl[LSM_ACCEL_RANGES] = { 0x00, 0x08, 0x0c, 0x04 };
+#ifdef ENABLE_GYRO
+static const uint8_t lsm_fs_g[LSM_GYRO_RANGES] = { LSM_FS_125, 0x00, 0x04, 0x08, 0x0c };
+#endif // ENABLE_GYRO
+
+// Output data rate bits, by ODR index (see lsm.h)
+static const uint8_t lsm_odr_xl[LSM_ODRS] = { LSM_ODR_XL_12_5_HZ, LSM_ODR_XL_52_HZ };
+#ifdef ENABLE_GYRO
+static const uint8_t lsm_odr_g[LSM_ODRS] = { LSM_ODR_G_POWER_DOWN, LSM_ODR_G_52_HZ };
+#endif // ENABLE_GYRO
+
+// Time for a fresh sample at each ODR, in ACLK/64 ticks (~80ms, ~20ms)
+static const unsigned lsm_period[LSM_ODRS] = { 41, 10 };
+
+// What is set in the sensor (the control registers hold both, so changing
+// one rewrites the other). As set by lsm_init; on a warm boot, the caller
+// sets them again if it changed them.
+static unsigned lsm_odr = LSM_ODR_HIGH;
+static unsigned lsm_accel_range = 0;
+static unsigned lsm_gyro_range = 0;
+
 #ifdef ENABLE_GYRO
 #define FIRST_DATA_REG     LSM_REG_OUTX_L_G
 #define SAMPLE_LEN 12
@@ -28,56 +56,23 @@
 
 #define LSM_WHO_AM_I 0x69
 
-#define SAMPLE_PERIOD 10 /* @ 52Hz (must match ODR setting): ~20ms in ACLK/64 */
+// With the sample clock, samples are spaced by at least one ODR period, so
+// a fresh sample is always ready and we don't need to wait for it. (For the
+// low ODR, the check is with its user, see powermode.c.)
+#if defined(ENABLE_SAMPLE_CLOCK) && SAMPLE_CLOCK_HZ > 52
+#error SAMPLE_CLOCK_HZ must not exceed the LSM ODR (52 Hz)
+#endif
 
 static uint8_t sample_bytes[SAMPLE_LEN];
 
-
-static void set_reg(unsigned reg, unsigned val)
-{
-  UCB0CTLW0 |= UCTR | UCTXSTT; // transmit mode and start
-
-  // Have to wait for addr transmission to finish, otherwise the TXIFG does not
-  // behave as expected (both reg and val writes below fall through, despite
-  // waits on TXIFG).
-  while((UCB0CTLW0 & UCTXSTT));
-
-  while(!(UCB0IFG & UCTXIFG));
-  UCB0TXBUF = reg;
-
-  while(!(UCB0IFG & UCTXIFG));
-  UCB0TXBUF = val;
-
-  while(!(UCB0IFG & UCTXIFG));
-  UCB0CTLW0 |= UCTXSTP; // stop
-
-  while (UCB0STATW & UCBBUSY);
-}
-
 bool lsm_init()
 {
-  UCB0CTLW0 |= UCSWRST; // disable
-  UCB0I2CSA = LSM_SLAVE_ADDRESS;
-  UCB0CTLW0 &= ~UCSWRST; // enable
-
-  while (UCB0STATW & UCBBUSY);
-
-  UCB0CTLW0 |= UCTR | UCTXSTT; // transmit mode and start
-  while(!(UCB0IFG & UCTXIFG));
-  UCB0TXBUF = LSM_REG_WHO_AM_I;
-  while(!(UCB0IFG & UCTXIFG));
-
-  UCB0CTLW0 &= ~UCTR; // receive mode
-  UCB0CTLW0 |= UCTXSTT; // repeated start
-
-  // wait for addr transmission to finish, data transfer to start
-  while(UCB0CTLW0 & UCTXSTT);
-  UCB0CTLW0 |= UCTXSTP; // stop
-
-  while(!(UCB0IFG & UCRXIFG));
-  uint8_t id = UCB0RXBUF;
-
-  while (UCB0STATW & UCBBUSY);
+  uint8_t id;
+  int rc = i2c_read_regs(LSM_SLAVE_ADDRESS, LSM_REG_WHO_AM_I, &id, 1);
+  if (rc != I2C_OK) {
+    LOG("LSM id read failed: %i\r\n", rc);
+    return false;
+  }
 
   if (id != LSM_WHO_AM_I) {
     LOG("invalid LSM id: 0x%02x (expected 0x%02x)\r\n", id, LSM_WHO_AM_I);
@@ -86,48 +81,64 @@ bool lsm_init()
 
   LOG("LSM id: 0x%02x\r\n", id);
 
-  set_reg(LSM_REG_CTRL1_XL, LSM_ODR_XL_52_HZ);
+  rc = i2c_write_reg(LSM_SLAVE_ADDRESS, LSM_REG_CTRL1_XL, LSM_ODR_XL_52_HZ);
 #ifdef ENABLE_GYRO
-  set_reg(LSM_REG_CTRL2_G, LSM_ODR_G_52_HZ | LSM_FS_125);
+  if (rc == I2C_OK)
+    rc = i2c_write_reg(LSM_SLAVE_ADDRESS, LSM_REG_CTRL2_G, LSM_ODR_G_52_HZ | LSM_FS_125);
 #endif // ENABLE_GYRO
+  if (rc != I2C_OK) {
+    LOG("LSM config failed: %i\r\n", rc);
+    return false;
+  }
 
   return true;
 }
 
-void lsm_sample(lsm_t *sample) {
+/* Whether the sensor still holds the configuration set by init (i.e. it
+ * stayed powered while the MCU rebooted): the accelerometer is not in
+ * power-down, which is the power-on default (lsm_set_odr never powers it
+ * down, so any ODR will do). */
+bool lsm_check()
+{
+  uint8_t ctrl1_xl;
+  int rc = i2c_read_regs(LSM_SLAVE_ADDRESS, LSM_REG_CTRL1_XL, &ctrl1_xl, 1);
+  if (rc != I2C_OK) {
+    LOG("LSM CTRL1_XL read failed: %i\r\n", rc);
+    return false;
+  }
+
+  LOG("LSM CTRL1_XL: 0x%02x\r\n", ctrl1_xl);
+  return (ctrl1_xl & LSM_ODR_XL_MASK) != 0;
+}
+
+/* Returns I2C_OK or the error, in which case the sample is left as is */
+int lsm_sample(lsm_t *sample) {
 
-  // Wait for the first sample @ 52Hz
+#ifndef ENABLE_SAMPLE_CLOCK
+  // Wait for the first sample at the current ODR
   //
   // NOTE: yeah, this does not need to be blocking, but we can't
   // be sure that the app won't finish executing an interation
   // before this sensor period elapses period. 
-  msp_sleep(SAMPLE_PERIOD); /* ~20ms @ ACLK/64 */
-
-  UCB0CTLW0 |= UCSWRST; // disable
-  UCB0I2CSA = LSM_SLAVE_ADDRESS;
-  UCB0CTLW0 &= ~UCSWRST; // enable
-
-  UCB0CTLW0 |= UCTR | UCTXSTT; // transmit mode and start
-  while((UCB0CTLW0 & UCTXSTT));
-
-  while(!(UCB0IFG & UCTXIFG));
-  UCB0TXBUF = FIRST_DATA_REG;
-  while(!(UCB0IFG & UCTXIFG));
+  msp_sleep(lsm_period[lsm_odr]);
+#endif // !ENABLE_SAMPLE_CLOCK
 
-  UCB0CTLW0 &= ~UCTR; // receive mode
-  UCB0CTLW0 |= UCTXSTT; // repeated start
-
-  while(UCB0CTLW0 & UCTXSTT);
-
-  for (unsigned i = 0; i < SAMPLE_LEN; ++i) {
-    if (i == SAMPLE_LEN - 1)
-        UCB0CTLW0 |= UCTXSTP; // stop
-
-    while(!(UCB0IFG & UCRXIFG));
-    sample_bytes[i] = UCB0RXBUF;
+  unsigned skip = 0;
+#ifdef ENABLE_GYRO
+  // At the low ODR the gyro is powered down: read the accelerometer only
+  // (into its place after the gyro data), and report no rotation
+  if (lsm_odr == LSM_ODR_LOW) {
+    skip = SAMPLE_LEN - 6;
+    memset(sample_bytes, 0, skip);
   }
+#endif // ENABLE_GYRO
 
-  while (UCB0STATW & UCBBUSY);
+  int rc = i2c_read_regs(LSM_SLAVE_ADDRESS, skip ? LSM_REG_OUTX_L_XL : FIRST_DATA_REG,
+                         sample_bytes + skip, SAMPLE_LEN - skip);
+  if (rc != I2C_OK) {
+    LOG("[lsm] read failed: %i\r\n", rc);
+    return rc;
+  }
 
   LOG2("[lsm] sample bytes: ");
   for (unsigned i = 0; i < SAMPLE_LEN; ++i) {
@@ -158,4 +169,42 @@ void lsm_sample(lsm_t *sample) {
       ,sample->gx, sample->gy, sample->gz
 #endif // ENABLE_GYRO
       );
+  return I2C_OK;
+}
+
+/* Switch the full scale (by range index), keeping the ODR. Returns I2C_OK
+ * or the error, after which either scale may or may not have changed. */
+int lsm_set_range(unsigned accel, unsigned gyro)
+{
+  lsm_accel_range = accel;
+  lsm_gyro_range = gyro;
+
+  int rc = i2c_write_reg(LSM_SLAVE_ADDRESS, LSM_REG_CTRL1_XL,
+                         lsm_odr_xl[lsm_odr] | lsm_fs_xl[accel]);
+#ifdef ENABLE_GYRO
+  if (rc == I2C_OK)
+    rc = i2c_write_reg(LSM_SLAVE_ADDRESS, LSM_REG_CTRL2_G, lsm_odr_g[lsm_odr] | lsm_fs_g[gyro]);
+#endif // ENABLE_GYRO
+
+  LOG("[lsm] range: accel %u gyro %u: %i\r\n", accel, gyro, rc);
+  return rc;
+}
+
+/* Switch the output data rate (LSM_ODR_*), keeping the full scales. The
+ * wait for a sample in lsm_sample follows it. Returns I2C_OK or the error,
+ * after which either rate may or may not have changed. */
+int lsm_set_odr(unsigned odr)
+{
+  lsm_odr = odr;
+
+  int rc = i2c_write_reg(LSM_SLAVE_ADDRESS, LSM_REG_CTRL1_XL,
+                         lsm_odr_xl[odr] | lsm_fs_xl[lsm_accel_range]);
+#ifdef ENABLE_GYRO
+  if (rc == I2C_OK)
+    rc = i2c_write_reg(LSM_SLAVE_ADDRESS, LSM_REG_CTRL2_G,
+                       lsm_odr_g[odr] | lsm_fs_g[lsm_gyro_range]);
+#endif // ENABLE_GYRO
+
+  LOG("[lsm] odr %u: %i\r\n", odr, rc);
+  return rc;
 }
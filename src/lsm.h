@@ -7,6 +7,16 @@ typedef struct {
 } lsm_t;
 
 bool lsm_init();
-void lsm_sample(lsm_t *sample);
+bool lsm_check();
+int lsm_sample(lsm_t *sample);
+int lsm_set_range(unsigned accel, unsigned gyro);
+int lsm_set_odr(unsigned odr);
+
+#define LSM_ACCEL_RANGES 4 /* +-2, 4, 8, 16 g */
+#define LSM_GYRO_RANGES  5 /* +-125, 250, 500, 1000, 2000 dps */
+
+#define LSM_ODR_LOW  0 /* accel 12.5 Hz, gyro powered down */
+#define LSM_ODR_HIGH 1 /* accel and gyro 52 Hz (as set by lsm_init) */
+#define LSM_ODRS     2
 
 #endif // LSM_H
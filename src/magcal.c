@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "magcal.h"
+
+#define SCALE_ONE (1 << PKT_CAL_SCALE_SHIFT)
+#define SCALE_MAX ((1 << PKT_CAL_SCALE_BITS) - 1)
+
+// Calibrated values stay within the range of the readings, and off the
+// overflow value, which remains reserved
+#define CAL_MIN (-(1L << (SAMP_BITS_MAG - 1)) + 1)
+#define CAL_MAX ((1L << (SAMP_BITS_MAG - 1)) - 1)
+#define OFFSET_MIN (-(1 << (PKT_CAL_OFFSET_BITS - 1)))
+#define OFFSET_MAX ((1 << (PKT_CAL_OFFSET_BITS - 1)) - 1)
+
+static void compute(magcal_t *mc)
+{
+  magcal_cal_t *cal = &mc->cal;
+
+  for (unsigned i = 0; i < MAGCAL_AXES; ++i) {
+    if (mc->hi[i] - mc->lo[i] < MAGCAL_MIN_SPAN) {
+      cal->valid = false;
+      return;
+    }
+  }
+
+  for (unsigned i = 0; i < MAGCAL_AXES; ++i) {
+    unsigned radius = (unsigned)(mc->hi[i] - mc->lo[i]) / 2;
+    unsigned s = ((unsigned)MAGCAL_RADIUS << PKT_CAL_SCALE_SHIFT) / radius;
+
+    cal->offset[i] = (mc->lo[i] + mc->hi[i]) / 2;
+    cal->scale[i] = s > SCALE_MAX ? SCALE_MAX : (s == 0 ? 1 : s);
+  }
+  cal->valid = true;
+}
+
+/* No extremes seen yet */
+void magcal_init(magcal_t *mc)
+{
+  for (unsigned i = 0; i < MAGCAL_AXES; ++i) {
+    mc->lo[i] = INT16_MAX;
+    mc->hi[i] = INT16_MIN;
+  }
+  mc->decay_count = 0;
+  mc->cal.valid = false;
+}
+
+/* Feed a raw reading to the estimator */
+void magcal_update(magcal_t *mc, const magnet_t *m)
+{
+  const int v[MAGCAL_AXES] = { m->x, m->y, m->z };
+  bool changed = false;
+
+  if (v[0] == MAGNETOMETER_OVERFLOW ||
+      v[1] == MAGNETOMETER_OVERFLOW ||
+      v[2] == MAGNETOMETER_OVERFLOW)
+    return;
+
+  for (unsigned i = 0; i < MAGCAL_AXES; ++i) {
+    if (v[i] < mc->lo[i]) {
+      mc->lo[i] = v[i];
+      changed = true;
+    }
+    if (v[i] > mc->hi[i]) {
+      mc->hi[i] = v[i];
+      changed = true;
+    }
+  }
+
+  if (++mc->decay_count >= MAGCAL_DECAY_INTERVAL) {
+    mc->decay_count = 0;
+    for (unsigned i = 0; i < MAGCAL_AXES; ++i) {
+      if (mc->hi[i] - mc->lo[i] >= MAGCAL_MIN_SPAN + 2) {
+        mc->lo[i]++;
+        mc->hi[i]--;
+        changed = true;
+      }
+    }
+  }
+
+  if (changed)
+    compute(mc);
+}
+
+static int apply_axis(const magcal_cal_t *cal, int v, unsigned i)
+{
+  if (v == MAGNETOMETER_OVERFLOW)
+    return v;
+
+  int32_t c = ((int32_t)(v - cal->offset[i]) * cal->scale[i]) >> PKT_CAL_SCALE_SHIFT;
+  if (c < CAL_MIN)
+    c = CAL_MIN;
+  else if (c > CAL_MAX)
+    c = CAL_MAX;
+  if (c == MAGNETOMETER_OVERFLOW)
+    c++;
+  return c;
+}
+
+/* Correct a raw reading in place (no-op until the calibration is valid) */
+void magcal_apply(const magcal_cal_t *cal, magnet_t *m)
+{
+  if (!cal->valid)
+    return;
+
+  m->x = apply_axis(cal, m->x, 0);
+  m->y = apply_axis(cal, m->y, 1);
+  m->z = apply_axis(cal, m->z, 2);
+}
+
+/* Calibration of one axis, for telemetry (the caller rotates the axis) */
+void magcal_report(const magcal_cal_t *cal, unsigned axis, pkt_cal_t *report)
+{
+  if (!cal->valid) {
+    report->axis = PKT_CAL_AXIS_NONE;
+    report->offset = 0;
+    report->scale = SCALE_ONE;
+    return;
+  }
+
+  int offset = cal->offset[axis];
+  report->axis = axis;
+  report->offset = offset < OFFSET_MIN ? OFFSET_MIN :
+                   offset > OFFSET_MAX ? OFFSET_MAX : offset;
+  report->scale = cal->scale[axis];
+}
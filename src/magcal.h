@@ -0,0 +1,64 @@
+#ifndef MAGCAL_H
+#define MAGCAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pkt.h"
+#include "magnetometer.h"
+
+// Hard/soft-iron calibration of the magnetometer, learnt on board.
+//
+// The extremes seen on each axis bound the (ideally spherical) locus of the
+// field: the center is the hard-iron offset, and the radius on each axis
+// gives a per-axis scale (the diagonal of the soft-iron correction) that
+// maps the field onto MAGCAL_RADIUS. By default that is the largest
+// magnitude that fits in the packed field, so the bits of the packet go to
+// the signal instead of to the bias.
+//
+// The state of the estimator (magcal_t) belongs to the caller, which keeps
+// it in a channel of the task that reads the magnetometer: a task that
+// re-executes after a power failure then starts over from the state it
+// started from, and the decay below is not applied twice. To follow slow
+// changes (and forget outliers), the extremes are pulled in by one unit
+// every MAGCAL_DECAY_INTERVAL samples.
+
+#ifndef MAGCAL_RADIUS
+#define MAGCAL_RADIUS (((1 << (PKT_FIELD_MAG_BITS - 1)) - 1) * MAG_DOWNSAMPLE_FACTOR)
+#endif
+
+// Spread needed on every axis before the calibration is applied
+#ifndef MAGCAL_MIN_SPAN
+#define MAGCAL_MIN_SPAN 64
+#endif
+
+#ifndef MAGCAL_DECAY_INTERVAL
+#define MAGCAL_DECAY_INTERVAL 256
+#endif
+
+#define MAGCAL_AXES 3
+
+#if (MAGCAL_RADIUS << PKT_CAL_SCALE_SHIFT) > 0xffff
+#error MAGCAL_RADIUS too large for the scale arithmetic
+#endif
+
+// The calibration that the extremes give
+typedef struct {
+  bool valid;
+  int offset[MAGCAL_AXES];
+  uint8_t scale[MAGCAL_AXES];
+} magcal_cal_t;
+
+typedef struct {
+  int lo[MAGCAL_AXES];
+  int hi[MAGCAL_AXES];
+  unsigned decay_count;
+  magcal_cal_t cal;
+} magcal_t;
+
+void magcal_init(magcal_t *mc);
+void magcal_update(magcal_t *mc, const magnet_t *m);
+void magcal_apply(const magcal_cal_t *cal, magnet_t *m);
+void magcal_report(const magcal_cal_t *cal, unsigned axis, pkt_cal_t *report);
+
+#endif // MAGCAL_H
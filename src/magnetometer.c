@@ -1,35 +1,25 @@
+#include <stdint.h>
+#include <stdbool.h>
+
 #include <libmsp/sleep.h>
 #include <libio/console.h>
-#include <libmspware/driverlib.h>
 
 #include "magnetometer.h"
+#include "i2c.h"
 
 #define MAG_ID_LEN 3
 #define MAG_SAMPLE_LEN 6
 
-static unsigned char rawMagData[MAG_SAMPLE_LEN];
-static unsigned char magnetometerId[MAG_ID_LEN];
+static uint8_t rawMagData[MAG_SAMPLE_LEN];
+static uint8_t magnetometerId[MAG_ID_LEN];
 
 bool magnetometer_init(void) {
-  int i;
-
-  EUSCI_B_I2C_disable(EUSCI_B0_BASE);
-  EUSCI_B_I2C_setSlaveAddress(EUSCI_B0_BASE, MAGNETOMETER_SLAVE_ADDRESS);
-  EUSCI_B_I2C_enable(EUSCI_B0_BASE);
-
-  EUSCI_B_I2C_setMode(EUSCI_B0_BASE, EUSCI_B_I2C_TRANSMIT_MODE);
-  EUSCI_B_I2C_masterSendSingleByte(EUSCI_B0_BASE, MAGNETOMETER_ID_ADDRESS);
-  while(EUSCI_B_I2C_isBusBusy(EUSCI_B0_BASE));
-
-  EUSCI_B_I2C_setMode(EUSCI_B0_BASE, EUSCI_B_I2C_RECEIVE_MODE);
-  EUSCI_B_I2C_masterReceiveStart(EUSCI_B0_BASE);
-  for (i = 0; i < MAG_ID_LEN; i++) {
-    if (i == MAG_ID_LEN - 1)
-        magnetometerId[i] = EUSCI_B_I2C_masterReceiveMultiByteFinish(EUSCI_B0_BASE);
-    else
-        magnetometerId[i] = EUSCI_B_I2C_masterReceiveMultiByteNext(EUSCI_B0_BASE);
+  int rc = i2c_read_regs(MAGNETOMETER_SLAVE_ADDRESS, MAGNETOMETER_ID_ADDRESS,
+                         magnetometerId, MAG_ID_LEN);
+  if (rc != I2C_OK) {
+    LOG("[mag] error: chip ID read failed: %i\r\n", rc);
+    return false;
   }
-  while(EUSCI_B_I2C_isBusBusy(EUSCI_B0_BASE));
 
   LOG("[mag] chip ID: %c%c%c\r\n",
       magnetometerId[0], magnetometerId[1], magnetometerId[2]);
@@ -38,21 +28,19 @@ bool magnetometer_init(void) {
     return false;
   }
 
-  EUSCI_B_I2C_setMode(EUSCI_B0_BASE, EUSCI_B_I2C_TRANSMIT_MODE);
-
   /* 1 raw sample per data point, normal measurement mode (MS0 MS1 = 00) */
-  EUSCI_B_I2C_masterSendStart(EUSCI_B0_BASE);
-  EUSCI_B_I2C_masterSendMultiByteNext(EUSCI_B0_BASE, MAGNETOMETER_CONFIG_REGISTER_A);
-  EUSCI_B_I2C_masterSendMultiByteFinish(EUSCI_B0_BASE, MAGNETOMETER_NUMAVG_1);
-  while(EUSCI_B_I2C_isBusBusy(EUSCI_B0_BASE));
+  rc = i2c_write_reg(MAGNETOMETER_SLAVE_ADDRESS, MAGNETOMETER_CONFIG_REGISTER_A,
+                     MAGNETOMETER_NUMAVG_1);
 
   /* Set gain */
-  EUSCI_B_I2C_masterSendStart(EUSCI_B0_BASE);
-  EUSCI_B_I2C_masterSendMultiByteNext(EUSCI_B0_BASE, MAGNETOMETER_CONFIG_REGISTER_B);
-  EUSCI_B_I2C_masterSendMultiByteFinish(EUSCI_B0_BASE, MAGNETOMETER_GAIN_1);
-  while(EUSCI_B_I2C_isBusBusy(EUSCI_B0_BASE));
+  if (rc == I2C_OK)
+    rc = i2c_write_reg(MAGNETOMETER_SLAVE_ADDRESS, MAGNETOMETER_CONFIG_REGISTER_B,
+                       MAGNETOMETER_GAIN_1);
 
-  EUSCI_B_I2C_disable(EUSCI_B0_BASE);
+  if (rc != I2C_OK) {
+    LOG("[mag] error: config failed: %i\r\n", rc);
+    return false;
+  }
 
   // Wait for analog circuitry to initialize
   msp_sleep(26); // 50ms at ACLK/64=32768/64
@@ -60,32 +48,41 @@ bool magnetometer_init(void) {
   return true;
 }
 
-void magnetometer_read(magnet_t* coordinates) {
+/* Whether the sensor still holds the configuration set by init (i.e. it
+ * stayed powered while the MCU rebooted): config A differs from its
+ * power-on default (0x10). Costs one register read instead of the ID read,
+ * the register writes and the settle delay. */
+bool magnetometer_check(void) {
+  uint8_t config_a;
+
+  int rc = i2c_read_regs(MAGNETOMETER_SLAVE_ADDRESS, MAGNETOMETER_CONFIG_REGISTER_A,
+                         &config_a, 1);
+  if (rc != I2C_OK) {
+    LOG("[mag] config A read failed: %i\r\n", rc);
+    return false;
+  }
+
+  LOG("[mag] config A: 0x%02x\r\n", config_a);
+  return config_a == MAGNETOMETER_NUMAVG_1;
+}
+
+/* Returns I2C_OK or the error, in which case the coordinates are left as is */
+int magnetometer_read(magnet_t* coordinates) {
   int i;
 
-  EUSCI_B_I2C_disable(EUSCI_B0_BASE);
-  EUSCI_B_I2C_setSlaveAddress(EUSCI_B0_BASE, MAGNETOMETER_SLAVE_ADDRESS);
-  EUSCI_B_I2C_enable(EUSCI_B0_BASE);
-
-  EUSCI_B_I2C_setMode(EUSCI_B0_BASE, EUSCI_B_I2C_TRANSMIT_MODE);
-  EUSCI_B_I2C_masterSendStart(EUSCI_B0_BASE);
-  EUSCI_B_I2C_masterSendMultiByteNext(EUSCI_B0_BASE, MAGNETOMETER_MODE_REGISTER_ADDRESS);
-  EUSCI_B_I2C_masterSendMultiByteFinish(EUSCI_B0_BASE, MAGNETOMETER_MODE_SINGLE_OUTPUT);
-  while(EUSCI_B_I2C_isBusBusy(EUSCI_B0_BASE));
-
-  // Wait for sample to be generated
-  msp_sleep(4); // ~6ms at ACLK/64=32768/64
-  
-  EUSCI_B_I2C_setMode(EUSCI_B0_BASE, EUSCI_B_I2C_RECEIVE_MODE);
-  EUSCI_B_I2C_masterReceiveStart(EUSCI_B0_BASE);
-  for (i = 0; i < MAG_SAMPLE_LEN; i++) {
-    if (i == MAG_SAMPLE_LEN - 1)
-        rawMagData[i] = EUSCI_B_I2C_masterReceiveMultiByteFinish(EUSCI_B0_BASE);
-    else
-        rawMagData[i] = EUSCI_B_I2C_masterReceiveMultiByteNext(EUSCI_B0_BASE);
+  int rc = i2c_write_reg(MAGNETOMETER_SLAVE_ADDRESS, MAGNETOMETER_MODE_REGISTER_ADDRESS,
+                         MAGNETOMETER_MODE_SINGLE_OUTPUT);
+  if (rc == I2C_OK) {
+    // Wait for sample to be generated
+    msp_sleep(4); // ~6ms at ACLK/64=32768/64
+
+    // The register pointer moved on to the first data register
+    rc = i2c_read(MAGNETOMETER_SLAVE_ADDRESS, rawMagData, MAG_SAMPLE_LEN);
+  }
+  if (rc != I2C_OK) {
+    LOG("[mag] read failed: %i\r\n", rc);
+    return rc;
   }
-  while(EUSCI_B_I2C_isBusBusy(EUSCI_B0_BASE));
-  EUSCI_B_I2C_disable(EUSCI_B0_BASE);
 
   LOG2("[mag] raw sample data: ");
   for (i = 0; i < MAG_SAMPLE_LEN; ++i)
@@ -98,4 +95,14 @@ void magnetometer_read(magnet_t* coordinates) {
 
   LOG("[mag] sample x %i y %i z %i\r\n",
       coordinates->x, coordinates->y, coordinates->z);
+  return I2C_OK;
+}
+
+/* Set the gain (MAGNETOMETER_GAIN_*). The first measurement after the
+ * change is still made with the previous gain. Returns I2C_OK or the error. */
+int magnetometer_set_gain(unsigned gain) {
+  int rc = i2c_write_reg(MAGNETOMETER_SLAVE_ADDRESS, MAGNETOMETER_CONFIG_REGISTER_B, gain);
+
+  LOG("[mag] gain 0x%02x: %i\r\n", gain, rc);
+  return rc;
 }
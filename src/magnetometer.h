@@ -17,12 +17,15 @@
 #define MAGNETOMETER_GAIN_5 0xA0  // 4.7 gauss
 #define MAGNETOMETER_GAIN_6 0xC0  // 5.6 gauss
 #define MAGNETOMETER_GAIN_7 0xE0  // 8.1 gauss
+#define MAGNETOMETER_GAIN(n) ((n) << 5)
 
 #define MAGNETOMETER_NUMAVG_1 0x00
 
 #define MAGNETOMETER_MODE_CONTINUOUS_OUTPUT 0x00
 #define MAGNETOMETER_MODE_SINGLE_OUTPUT 0x01
 
+#define MAGNETOMETER_OVERFLOW (-4096) // reading on overflow of any axis
+
 
 typedef struct {
   int x;
@@ -31,6 +34,8 @@ typedef struct {
 } magnet_t;
 
 bool magnetometer_init(void);
-void magnetometer_read(magnet_t* coordinates);
+bool magnetometer_check(void);
+int magnetometer_read(magnet_t* coordinates);
+int magnetometer_set_gain(unsigned gain);
 
 #endif
@@ -15,9 +15,23 @@
 #include <libmspuartlink/uartlink.h>
 
 #include "pins.h"
+#include "i2c.h"
 #include "temp_sensor.h"
 #include "magnetometer.h"
 #include "lsm.h"
+#include "pkt.h"
+#include "link.h"
+#include "sample_clock.h"
+#include "txq.h"
+#include "uartdma.h"
+#include "magcal.h"
+#include "autorange.h"
+#include "powermode.h"
+#include "spectrum.h"
+#include "bench.h"
+#include "trace.h"
+#include "archive.h"
+#include "energy.h"
 
 // Must be after any header that includes mps430.h due to
 // the workround of undef'ing 'OUT' (see pin_assign.h)
@@ -27,87 +41,275 @@
 #define WATCHPOINT(...)
 #endif
 
+/* Geometry of the cascade, set with CASCADE_* in bld/Makefile, which also
+   works out the sizes that libchain needs as literal numbers (for the self
+   channel initializers) */
+#ifndef WINDOW_DIV_SHIFT
+#define WINDOW_DIV_SHIFT 2 /* 2^WINDOW_DIV_SHIFT = WINDOW_SIZE */
 #define WINDOW_SIZE 4 /*number of samples in a window*/
 #define NUM_WINDOWS 4
-#define WINDOW_DIV_SHIFT 2 /* 2^WINDOW_DIV_SHIFT = NUM_WINDOWS */
 #define WINDOWS_SIZE 16 /* NUM_WINDOWS * WINDOW_SIZE (libchain needs a literal number) */
+#define PKT_WINDOW_LEVELS 0, NUM_WINDOWS - 1 /* the first and last windows */
+#endif // WINDOW_DIV_SHIFT
+
+/* The averages divide by shifting, and the indexes wrap by masking */
+#if WINDOW_SIZE != (1 << WINDOW_DIV_SHIFT)
+#error WINDOW_SIZE must be 2^WINDOW_DIV_SHIFT
+#endif
+#if WINDOWS_SIZE != NUM_WINDOWS * WINDOW_SIZE
+#error WINDOWS_SIZE must be NUM_WINDOWS * WINDOW_SIZE
+#endif
+#if NUM_WINDOWS < 1
+#error The cascade needs at least one level
+#endif
 
 /*Get coordinate coor from the sample samp in window win -- windows[WINGET(0,1)*/
 #define WINGET(win,samp) (WINDOW_SIZE*win + samp)
 
+#ifdef ENABLE_EMA_CASCADE
+/* Cascade level k > 0 is an exponential moving average of the window
+   averages with a time constant of 2^EMA_SHIFT(k) = WINDOW_SIZE^k windows,
+   as in a cascade that decimates by WINDOW_SIZE at each level. This grows
+   geometrically with k, unlike the windowed cascade, whose level k slides
+   over the last WINDOW_SIZE averages of level k-1 and so spans only
+   k * (WINDOW_SIZE - 1) + 1 windows: the two agree at level 1, and past it
+   the EMA levels reach much longer timescales for the same NUM_WINDOWS. */
+#define EMA_SHIFT(k) (WINDOW_DIV_SHIFT * (k))
+
+#if EMA_SHIFT(NUM_WINDOWS - 1) > 16
+#error EMA accumulator may overflow: reduce NUM_WINDOWS or WINDOW_DIV_SHIFT
+#endif
+#endif // ENABLE_EMA_CASCADE
+
+#ifdef ENABLE_DOUBLE_BUFFER
+/* The tasks of the cascade (from task_update_window_start to task_send) go
+   back to task_schedule after each step, which runs the next step or takes
+   the next sample in the meantime (see task_schedule); without it, each
+   step goes straight on to the next one. */
+#define CASCADE_NEXT(task) TRANSITION_TO(task_schedule)
+
+/* The steps of one run of the cascade, in order: each level of the
+   cascade is a pass of task_update_window_start then task_update_window
+   (only one with EMA levels, which are all updated in one pass) */
+#ifdef ENABLE_EMA_CASCADE
+#define CASCADE_PASSES 1
+#else // !ENABLE_EMA_CASCADE
+#define CASCADE_PASSES NUM_WINDOWS
+#endif // !ENABLE_EMA_CASCADE
+
+#ifdef ENABLE_ARCHIVE
+#define CASCADE_ARCHIVE_STAGES 1 /* archive, after send */
+#else // !ENABLE_ARCHIVE
+#define CASCADE_ARCHIVE_STAGES 0
+#endif // !ENABLE_ARCHIVE
+
+#if VERBOSE > 0
+#define CASCADE_STAGES (2 * CASCADE_PASSES + 3 + CASCADE_ARCHIVE_STAGES) /* + output, pack, send */
+#else // VERBOSE
+#define CASCADE_STAGES (2 * CASCADE_PASSES + 2 + CASCADE_ARCHIVE_STAGES) /* + pack, send */
+#endif // VERBOSE
+#else // !ENABLE_DOUBLE_BUFFER
+#define CASCADE_NEXT(task) TRANSITION_TO(task)
+#endif // !ENABLE_DOUBLE_BUFFER
+
+#ifdef ENABLE_JIT_COALESCE
+/* Whether task_update_window goes on with the next level of the cascade in
+   the same run (one transition, so one commit of the channels, for all
+   those levels), rather than in a run of its own: while the energy is high
+   (see energy.h), so that a power failure does not lose the work of the
+   run, and, with double buffering, while no sample is due. When the energy
+   gets low, the levels go back to a pair of runs each, which commit their
+   work as they go. */
+#if defined(ENABLE_DOUBLE_BUFFER) && defined(ENABLE_SAMPLE_CLOCK)
+#define CASCADE_COALESCE() (energy_high() && !sample_clock_pending())
+#else // !ENABLE_DOUBLE_BUFFER || !ENABLE_SAMPLE_CLOCK
+#define CASCADE_COALESCE() energy_high()
+#endif // !ENABLE_DOUBLE_BUFFER || !ENABLE_SAMPLE_CLOCK
+#ifdef ENABLE_EMA_CASCADE
+#error ENABLE_JIT_COALESCE needs the windowed cascade (the EMA one updates all levels in one run)
+#endif // ENABLE_EMA_CASCADE
+#else // !ENABLE_JIT_COALESCE
+#define CASCADE_COALESCE() false
+#endif // !ENABLE_JIT_COALESCE
+
+// A sample, or an average: one value per field of the descriptor table in
+// pkt.h, indexed by PKT_F_<name>
 typedef struct _samp_t{
-  int temp;
-  int mx;
-  int my;
-  int mz;
-  int ax;
-  int ay;
-  int az;
-#ifdef ENABLE_GYRO
-  int gx;
-  int gy;
-  int gz;
-#endif // ENABLE_GYRO
+  int16_t v[PKT_NUM_FIELDS];
+#ifdef ENABLE_SAMPLE_CLOCK
+  sample_tick_t tick; /* not averaged: a window carries the tick of its last sample */
+#endif // ENABLE_SAMPLE_CLOCK
+#ifdef ENABLE_AUTORANGE
+  uint8_t range; /* not averaged: a window carries the largest range of each sensor */
+#endif // ENABLE_AUTORANGE
 } samp_t;
 
-// Type for pkt sent over the radio (via UART)
+#ifdef ENABLE_AUTORANGE
+#define SAMP_RANGE(s) ((s)->range)
+#else // !ENABLE_AUTORANGE
+#define SAMP_RANGE(s) 0
+#endif // !ENABLE_AUTORANGE
+
+/* Shift that brings a field down to at most STAT_BITS for the variance
+ * accumulators in the statistics kernel */
+#define STAT_BITS 12
+#define STAT_SHIFT(sample_bits) ((sample_bits) > STAT_BITS ? (sample_bits) - STAT_BITS : 0)
+
+#ifdef ENABLE_EMA_CASCADE
+// State of one EMA level: the average scaled up by 2^EMA_SHIFT(k), so that
+// the fraction is kept and small changes don't get stuck in truncation
+typedef struct {
+  long v[PKT_NUM_FIELDS];
+} ema_t;
+#endif // ENABLE_EMA_CASCADE
+
+#ifdef ENABLE_WINDOW_STATS
+typedef struct {
+  samp_t min;
+  samp_t max;
+  samp_t lvar; /* log2 of the variance in sensor units: var < 2^lvar */
+} samp_stats_t;
+#endif // ENABLE_WINDOW_STATS
 
-// Transmit first and last windows only
-static const unsigned pkt_window_indexes[] = { 0, NUM_WINDOWS - 1 };
-#define PKT_NUM_WINDOWS (sizeof(pkt_window_indexes) / sizeof(pkt_window_indexes[0]))
-
-typedef struct __attribute__((packed)) {
-    int temp:8;
-    int mx:4;
-    int my:4;
-    int mz:4;
-    int ax:4;
-    int ay:4;
-    int az:4;
-#ifdef ENABLE_GYRO
-    int gx:4;
-    int gy:4;
-    int gz:4;
-#endif // ENABLE_GYRO
-} pkt_win_t;
+// Type for pkt sent over the radio (via UART)
 
-typedef struct __attribute__((packed)) {
-    pkt_win_t windows[PKT_NUM_WINDOWS];
+// Transmit the levels of the cascade in PKT_WINDOW_LEVELS only (with
+// ENABLE_LINK_BUDGET, those first, then the others as the budget allows)
+static const unsigned pkt_window_indexes[] = { PKT_WINDOW_LEVELS };
+#define PKT_NUM_LEVELS (sizeof(pkt_window_indexes) / sizeof(pkt_window_indexes[0]))
+#ifdef ENABLE_LINK_BUDGET
+#define PKT_NUM_WINDOWS NUM_WINDOWS /* a slot per level, see pkt_compose() */
+#if NUM_WINDOWS > PKT_MAX_LEVELS
+#error ENABLE_LINK_BUDGET needs NUM_WINDOWS <= PKT_MAX_LEVELS (the level mask is a byte)
+#endif
+#else // !ENABLE_LINK_BUDGET
+#define PKT_NUM_WINDOWS PKT_NUM_LEVELS
+#endif // !ENABLE_LINK_BUDGET
+
+#ifdef ENABLE_WINDOW_STATS
+// Transmit min, max, variance of the first window (i.e. of the raw samples)
+static const unsigned pkt_stats_indexes[] = { 0 };
+#define PKT_NUM_STATS (sizeof(pkt_stats_indexes) / sizeof(pkt_stats_indexes[0]))
+#endif // ENABLE_WINDOW_STATS
+
+// Windows packed according to the field schema in pkt.h. With
+// ENABLE_LINK_BUDGET, the packet is composed from this one as it goes out
+// (see pkt_compose), by the header.
+typedef struct {
+#ifdef ENABLE_LINK_BUDGET
+    uint8_t hdr[PKT_HDR_SIZE];
+#endif // ENABLE_LINK_BUDGET
+    uint8_t windows[PKT_NUM_WINDOWS][PKT_WIN_SIZE];
+#ifdef ENABLE_WINDOW_STATS
+    uint8_t stats[PKT_NUM_STATS][PKT_STATS_SIZE];
+#endif // ENABLE_WINDOW_STATS
+#ifdef ENABLE_MAG_CAL
+    uint8_t cal[PKT_CAL_SIZE];
+#endif // ENABLE_MAG_CAL
+#ifdef ENABLE_SPECTRUM
+    uint8_t peaks[PKT_PEAKS_SIZE];
+#endif // ENABLE_SPECTRUM
+#ifdef ENABLE_AUTORANGE
+    uint8_t ranges[PKT_NUM_WINDOWS][PKT_RANGE_SIZE];
+#ifdef ENABLE_WINDOW_STATS
+    uint8_t stats_ranges[PKT_NUM_STATS][PKT_RANGE_SIZE];
+#endif // ENABLE_WINDOW_STATS
+#endif // ENABLE_AUTORANGE
 } pkt_t;
 
-/* downsample to signed 4-bit int: 4-bit of downsampled data (i.e [-2^3,+2^3])*/
-#define PKT_FIELD_MAG_BITS 4
-#define SENSOR_BITS_MAG    12
-#define NOT_FULL_SCALE_FACTOR_MAG 2 /* n, where scaling factor is decreased by 2^n because
-                                       the actual dynamic range of the quantity is smaller than full scale */
-#define MAG_DOWNSAMPLE_FACTOR (1 << (SENSOR_BITS_MAG - PKT_FIELD_MAG_BITS - NOT_FULL_SCALE_FACTOR_MAG))
-
-
-#define PKT_FIELD_ACCEL_BITS 4
-#define SENSOR_BITS_ACCEL    16
-#define NOT_FULL_SCALE_FACTOR_ACCEL 0 /* n, where scaling factor is decreased by 2^n because
-                                       the actual dynamic range of the quantity is smaller than full scale */
-#define ACCEL_DOWNSAMPLE_FACTOR (1 << (SENSOR_BITS_ACCEL - PKT_FIELD_ACCEL_BITS - NOT_FULL_SCALE_FACTOR_ACCEL))
-
-#define ACCEL_MIN  (-(1 << (PKT_FIELD_ACCEL_BITS - 1))) // -1 because signed
-#define ACCEL_MAX  ((1 << (PKT_FIELD_ACCEL_BITS - 1)) - 1) // -1 because signed, -1 because max value
-
-
-#define PKT_FIELD_GYRO_BITS 4
-#define SENSOR_BITS_GYRO    16
-#define NOT_FULL_SCALE_FACTOR_GYRO 1 /* n, where scaling factor is decreased by 2^n because
-                                       the actual dynamic range of the quantity is smaller than full scale */
-#define GYRO_DOWNSAMPLE_FACTOR (1 << (SENSOR_BITS_GYRO - PKT_FIELD_GYRO_BITS - NOT_FULL_SCALE_FACTOR_GYRO))
-
-#define GYRO_MIN  (-(1 << (PKT_FIELD_GYRO_BITS - 1))) // -1 because signed
-#define GYRO_MAX  ((1 << (PKT_FIELD_GYRO_BITS - 1)) - 1) // -1 because signed, -1 because max value
+#ifdef ENABLE_TX_SUPPRESS
+// A packet is sent only if it differs from the last one sent, by more than
+// the threshold of the sensor in some field (in packed units, i.e. 0 sends
+// any change), or if the last TX_KEYFRAME_INTERVAL - 1 were not sent
+#ifndef TX_KEYFRAME_INTERVAL
+#define TX_KEYFRAME_INTERVAL 8
+#endif
+#ifndef TX_SUPPRESS_THRESHOLD
+#define TX_SUPPRESS_THRESHOLD 0
+#endif
+#ifndef TX_SUPPRESS_THRESHOLD_TEMP
+#define TX_SUPPRESS_THRESHOLD_TEMP TX_SUPPRESS_THRESHOLD
+#endif
+#ifndef TX_SUPPRESS_THRESHOLD_MAG
+#define TX_SUPPRESS_THRESHOLD_MAG TX_SUPPRESS_THRESHOLD
+#endif
+#ifndef TX_SUPPRESS_THRESHOLD_ACCEL
+#define TX_SUPPRESS_THRESHOLD_ACCEL TX_SUPPRESS_THRESHOLD
+#endif
+#ifndef TX_SUPPRESS_THRESHOLD_GYRO
+#define TX_SUPPRESS_THRESHOLD_GYRO TX_SUPPRESS_THRESHOLD
+#endif
+#endif // ENABLE_TX_SUPPRESS
+
+#ifdef ENABLE_LINK_BUDGET
+// The packets are composed to fit a budget of payload bytes per transmit
+// opportunity (see pkt_choose), between the smallest composition and
+// LINK_BUDGET_MAX (0 for the whole packet). The budget grows by
+// LINK_BUDGET_STEP at each opportunity at which the link has drained the
+// last frame, shrinks by the backlog otherwise (with ENABLE_UART_DMA: the
+// bytes of the frame that are not out yet), and halves after a reboot from
+// a power failure. Without ENABLE_UART_DMA the send blocks until the frame
+// is out, so only the reboots bring the budget down.
+#ifndef LINK_BUDGET_MAX
+#define LINK_BUDGET_MAX 0
+#endif
+#ifndef LINK_BUDGET_STEP
+#define LINK_BUDGET_STEP 2
+#endif
+// The fields that the windows keep when not even the levels in
+// PKT_WINDOW_LEVELS fit with all of them
+#ifndef PKT_GROUPS_LOW
+#define PKT_GROUPS_LOW (PKT_GROUP(MAG) | PKT_GROUP(ACCEL))
+#endif
 
+#ifdef ENABLE_AUTORANGE
+#define PKT_WIN_RANGE_SIZE PKT_RANGE_SIZE
+#else // !ENABLE_AUTORANGE
+#define PKT_WIN_RANGE_SIZE 0
+#endif // !ENABLE_AUTORANGE
+/* The bytes of the frame payload besides the windows and their range codes
+   (the header, and the sequence number with ENABLE_TXQ) */
+#define PKT_FIXED_SIZE (MAX_PKT_SIZE - PKT_NUM_WINDOWS * (PKT_WIN_SIZE + PKT_WIN_RANGE_SIZE))
+#if LINK_BUDGET_MAX > 0
+#define PKT_BUDGET_MAX LINK_BUDGET_MAX
+#else // LINK_BUDGET_MAX
+#define PKT_BUDGET_MAX MAX_PKT_SIZE
+#endif // LINK_BUDGET_MAX
+
+// Cleared by a reboot: task_pack tells from it that the power failed since
+// the last packet
+static bool pack_powered;
+#endif // ENABLE_LINK_BUDGET
 
 static bool mag_ok;
 static bool lsm_ok;
 
-// Put it here instead of on the stack
-static lsm_t lsm_samp;
+#if defined(ENABLE_AUTORANGE) || defined(ENABLE_POWER_MODES)
+// Cleared by a reboot: task_sample brings the sensors back to the ranges
+// and the mode in its self channel on its first run after a boot
+static bool sample_powered;
+#endif // ENABLE_AUTORANGE || ENABLE_POWER_MODES
+
+#ifdef ENABLE_WARM_BOOT
+// Whether the full init of each sensor completed: cleared before it starts,
+// so that only a sensor that was fully configured is ever trusted on boot
+static __nv bool mag_configured = false;
+static __nv bool lsm_configured = false;
+
+// Whether the magnetometer kept its configuration over the last boot
+static bool mag_warm;
+#endif // ENABLE_WARM_BOOT
+
+#ifdef ENABLE_TXQ
+#define MAX_PKT_SIZE sizeof(txq_pkt_t)
+#else // !ENABLE_TXQ
+#define MAX_PKT_SIZE sizeof(pkt_t)
+#endif // !ENABLE_TXQ
+#ifdef ENABLE_ARCHIVE
+#define MAX_PAYLOAD_SIZE (ARCHIVE_BLOCK_SIZE > MAX_PKT_SIZE ? ARCHIVE_BLOCK_SIZE : MAX_PKT_SIZE)
+#else // !ENABLE_ARCHIVE
+#define MAX_PAYLOAD_SIZE MAX_PKT_SIZE
+#endif // !ENABLE_ARCHIVE
 
 // Channel declarations
 
@@ -115,6 +317,42 @@ struct msg_sample{
     CHAN_FIELD(samp_t, sample);
 };
 
+// State of task_sample, kept in its self channel so that a re-executed
+// task_sample starts over from it: the last readings, which a sample falls
+// back to when a read fails or is skipped (zero until the first one), and
+// the estimators that the readings feed
+typedef struct {
+  magnet_t mag_last;
+  lsm_t lsm_last; // normalized with ENABLE_AUTORANGE
+#ifdef ENABLE_MAG_CAL
+  magcal_t magcal;
+#endif // ENABLE_MAG_CAL
+#ifdef ENABLE_AUTORANGE
+  autorange_t autorange;
+#endif // ENABLE_AUTORANGE
+#ifdef ENABLE_POWER_MODES
+  powermode_t power;
+#endif // ENABLE_POWER_MODES
+} sample_state_t;
+
+struct msg_sample_state{
+    CHAN_FIELD(sample_state_t, state);
+};
+
+struct msg_self_sample_state{
+    SELF_CHAN_FIELD(sample_state_t, state);
+};
+#define FIELD_INIT_msg_self_sample_state { \
+    SELF_FIELD_INITIALIZER \
+}
+
+#ifdef ENABLE_MAG_CAL
+/* The calibration that task_sample applied to the last reading */
+struct msg_mag_cal{
+    CHAN_FIELD(magcal_cal_t, cal);
+};
+#endif // ENABLE_MAG_CAL
+
 struct msg_sample_avg_in{
   CHAN_FIELD(task_t *, next_task);
   CHAN_FIELD_ARRAY(samp_t, window, WINDOW_SIZE);
@@ -122,50 +360,351 @@ struct msg_sample_avg_in{
 
 struct msg_sample_avg_out{
   CHAN_FIELD(samp_t, average);
+#ifdef ENABLE_WINDOW_STATS
+  CHAN_FIELD(samp_stats_t, stats);
+#endif // ENABLE_WINDOW_STATS
 };
 
 struct msg_sample_window{
   CHAN_FIELD_ARRAY(samp_t, window, WINDOW_SIZE);
 };
 
+#ifdef ENABLE_DOUBLE_BUFFER
+/* Two windows of samples: one fills while the cascade reads the other */
+struct msg_sample_buffers{
+  CHAN_FIELD_ARRAY(samp_t, buffers, 2 * WINDOW_SIZE);
+};
+#endif // ENABLE_DOUBLE_BUFFER
+
+
+#ifdef ENABLE_EMA_CASCADE
+
+struct msg_sample_windows{
+    CHAN_FIELD_ARRAY(ema_t, ema, NUM_WINDOWS);
+};
+
+struct msg_self_sample_windows{
+    SELF_CHAN_FIELD_ARRAY(ema_t, ema, NUM_WINDOWS);
+};
+#define FIELD_INIT_msg_self_sample_windows { \
+    SELF_FIELD_ARRAY_INITIALIZER(NUM_WINDOWS) \
+}
+
+#else // !ENABLE_EMA_CASCADE
 
 struct msg_sample_windows{
     CHAN_FIELD(int, which_window);
-    CHAN_FIELD_ARRAY(int, win_i, WINDOW_SIZE);
+    CHAN_FIELD_ARRAY(int, win_i, NUM_WINDOWS);
     CHAN_FIELD_ARRAY(samp_t, windows, NUM_WINDOWS * WINDOW_SIZE);
 };
 
 struct msg_self_sample_windows{
     SELF_CHAN_FIELD(int, which_window);
-    SELF_CHAN_FIELD_ARRAY(int, win_i, WINDOW_SIZE);
+    SELF_CHAN_FIELD_ARRAY(int, win_i, NUM_WINDOWS);
     SELF_CHAN_FIELD_ARRAY(samp_t, windows, WINDOWS_SIZE);
 };
 #define FIELD_INIT_msg_self_sample_windows { \
     SELF_FIELD_INITIALIZER, \
-    SELF_FIELD_ARRAY_INITIALIZER(WINDOW_SIZE), \
+    SELF_FIELD_ARRAY_INITIALIZER(NUM_WINDOWS), \
     SELF_FIELD_ARRAY_INITIALIZER(WINDOWS_SIZE) \
 }
 
+#endif // !ENABLE_EMA_CASCADE
+
 struct msg_index{
     CHAN_FIELD(int, i);
     CHAN_FIELD(bool, first_window);
+#ifdef ENABLE_DOUBLE_BUFFER
+    CHAN_FIELD(unsigned, filled);
+#endif // ENABLE_DOUBLE_BUFFER
 };
 
 struct msg_self_index{
     SELF_CHAN_FIELD(int, i);
     SELF_CHAN_FIELD(bool, first_window);
+#ifdef ENABLE_DOUBLE_BUFFER
+    SELF_CHAN_FIELD(unsigned, filled);
+#endif // ENABLE_DOUBLE_BUFFER
 };
+#ifdef ENABLE_DOUBLE_BUFFER
 #define FIELD_INIT_msg_self_index { \
+    SELF_FIELD_INITIALIZER, \
+    SELF_FIELD_INITIALIZER, \
+    SELF_FIELD_INITIALIZER \
+}
+#else // !ENABLE_DOUBLE_BUFFER
+#define FIELD_INIT_msg_self_index { \
+    SELF_FIELD_INITIALIZER, \
+    SELF_FIELD_INITIALIZER \
+}
+#endif // !ENABLE_DOUBLE_BUFFER
+
+#ifdef ENABLE_DOUBLE_BUFFER
+
+/* Count of windows filled (i.e. handed off to the cascade) */
+struct msg_filled{
+    CHAN_FIELD(unsigned, filled);
+};
+
+struct msg_schedule{
+    CHAN_FIELD(unsigned, filled);
+    CHAN_FIELD(unsigned, started);
+    CHAN_FIELD(unsigned, stage);
+#ifndef ENABLE_SAMPLE_CLOCK
+    CHAN_FIELD(bool, ran);
+#endif // !ENABLE_SAMPLE_CLOCK
+};
+
+struct msg_self_schedule{
+    SELF_CHAN_FIELD(unsigned, started);
+    SELF_CHAN_FIELD(unsigned, stage);
+#ifndef ENABLE_SAMPLE_CLOCK
+    SELF_CHAN_FIELD(bool, ran);
+#endif // !ENABLE_SAMPLE_CLOCK
+};
+#ifdef ENABLE_SAMPLE_CLOCK
+#define FIELD_INIT_msg_self_schedule { \
+    SELF_FIELD_INITIALIZER, \
     SELF_FIELD_INITIALIZER \
 }
+#else // !ENABLE_SAMPLE_CLOCK
+#define FIELD_INIT_msg_self_schedule { \
+    SELF_FIELD_INITIALIZER, \
+    SELF_FIELD_INITIALIZER, \
+    SELF_FIELD_INITIALIZER \
+}
+#endif // !ENABLE_SAMPLE_CLOCK
+
+/* The buffer that the first cascade level averages, -1 for the others */
+struct msg_buffer{
+    CHAN_FIELD(int, buf);
+};
+
+#ifdef ENABLE_JIT_COALESCE
+/* The next step, after task_update_window did several levels */
+struct msg_stage{
+    CHAN_FIELD(unsigned, stage);
+};
+#endif // ENABLE_JIT_COALESCE
+
+#endif // ENABLE_DOUBLE_BUFFER
 
 struct msg_window_averages {
     CHAN_FIELD_ARRAY(samp_t, win_avg, NUM_WINDOWS);
+#ifdef ENABLE_WINDOW_STATS
+    CHAN_FIELD_ARRAY(samp_stats_t, win_stats, NUM_WINDOWS);
+#endif // ENABLE_WINDOW_STATS
 };
 
+// The packet from task_pack to task_send is not in a channel: task_pack
+// packs it in place, and task_send hands it to the radio in place, instead
+// of a copy into the channel and another one out. Only task_pack writes it,
+// all of it, and task_send is done with it before the next task_pack, so a
+// re-executed task_pack packs the same packet again and a re-executed
+// task_send sends it again, as with a channel.
+static __nv pkt_t pkt_tx;
+
+#if defined(ENABLE_TXQ) || defined(ENABLE_TX_SUPPRESS)
+#define PKT_FLAGS
+#endif
+
+#ifdef PKT_FLAGS
 struct msg_pkt {
-    CHAN_FIELD(pkt_t, pkt);
+#ifdef ENABLE_TXQ
+    CHAN_FIELD(bool, event);
+#endif // ENABLE_TXQ
+#ifdef ENABLE_TX_SUPPRESS
+    CHAN_FIELD(bool, send);
+#endif // ENABLE_TX_SUPPRESS
+};
+#endif // PKT_FLAGS
+
+#if defined(ENABLE_SPECTRUM) || defined(ENABLE_TX_SUPPRESS) || defined(ENABLE_LINK_BUDGET) || \
+    defined(ENABLE_MAG_CAL)
+#define PACK_INIT
+#endif
+
+#ifdef PACK_INIT
+struct msg_pack_init {
+#ifdef ENABLE_SPECTRUM
+    CHAN_FIELD(pkt_peaks_t, peaks);
+#endif // ENABLE_SPECTRUM
+#ifdef ENABLE_TX_SUPPRESS
+    CHAN_FIELD(unsigned, unsent);
+#endif // ENABLE_TX_SUPPRESS
+#ifdef ENABLE_LINK_BUDGET
+    CHAN_FIELD(unsigned, budget);
+#endif // ENABLE_LINK_BUDGET
+#ifdef ENABLE_MAG_CAL
+    CHAN_FIELD(unsigned, cal_axis);
+#endif // ENABLE_MAG_CAL
 };
+#endif // PACK_INIT
+
+#if defined(ENABLE_TX_SUPPRESS) || defined(ENABLE_LINK_BUDGET) || defined(ENABLE_MAG_CAL)
+#define PACK_SELF
+#endif
+
+#ifdef PACK_SELF
+/* The last packet that went to task_send, and the count of packets
+   suppressed since; the link budget; the axis of the magnetometer
+   calibration in the next packet */
+struct msg_self_pack {
+#ifdef ENABLE_TX_SUPPRESS
+    SELF_CHAN_FIELD(pkt_t, last);
+    SELF_CHAN_FIELD(unsigned, unsent);
+#endif // ENABLE_TX_SUPPRESS
+#ifdef ENABLE_LINK_BUDGET
+    SELF_CHAN_FIELD(unsigned, budget);
+#endif // ENABLE_LINK_BUDGET
+#ifdef ENABLE_MAG_CAL
+    SELF_CHAN_FIELD(unsigned, cal_axis);
+#endif // ENABLE_MAG_CAL
+};
+/* An initializer per field, by option (libchain needs them all) */
+#ifdef ENABLE_TX_SUPPRESS
+#define PACK_SELF_INIT_TX_SUPPRESS SELF_FIELD_INITIALIZER, SELF_FIELD_INITIALIZER,
+#else // !ENABLE_TX_SUPPRESS
+#define PACK_SELF_INIT_TX_SUPPRESS
+#endif // !ENABLE_TX_SUPPRESS
+#ifdef ENABLE_LINK_BUDGET
+#define PACK_SELF_INIT_LINK_BUDGET SELF_FIELD_INITIALIZER,
+#else // !ENABLE_LINK_BUDGET
+#define PACK_SELF_INIT_LINK_BUDGET
+#endif // !ENABLE_LINK_BUDGET
+#ifdef ENABLE_MAG_CAL
+#define PACK_SELF_INIT_MAG_CAL SELF_FIELD_INITIALIZER,
+#else // !ENABLE_MAG_CAL
+#define PACK_SELF_INIT_MAG_CAL
+#endif // !ENABLE_MAG_CAL
+#define FIELD_INIT_msg_self_pack { \
+    PACK_SELF_INIT_TX_SUPPRESS \
+    PACK_SELF_INIT_LINK_BUDGET \
+    PACK_SELF_INIT_MAG_CAL \
+}
+#endif // PACK_SELF
+
+#ifdef ENABLE_TXQ
+
+// Packet as sent from the queue: sequence number (LSB first) with the
+// event flag in the top bit, so that the ground can reorder
+typedef struct {
+    uint8_t seq[2];
+    pkt_t pkt;
+} txq_pkt_t;
+
+struct msg_txq {
+    CHAN_FIELD_ARRAY(txq_meta_t, meta, TXQ_SIZE);
+    CHAN_FIELD(uint16_t, seq);
+    CHAN_FIELD(unsigned, cycle);
+};
+
+struct msg_self_txq {
+    SELF_CHAN_FIELD_ARRAY(txq_meta_t, meta, TXQ_SIZE);
+    SELF_CHAN_FIELD_ARRAY(pkt_t, pkts, TXQ_SIZE);
+    SELF_CHAN_FIELD(uint16_t, seq);
+    SELF_CHAN_FIELD(unsigned, cycle);
+};
+#define FIELD_INIT_msg_self_txq { \
+    SELF_FIELD_ARRAY_INITIALIZER(TXQ_SIZE), \
+    SELF_FIELD_ARRAY_INITIALIZER(TXQ_SIZE), \
+    SELF_FIELD_INITIALIZER, \
+    SELF_FIELD_INITIALIZER \
+}
+
+#endif // ENABLE_TXQ
+
+#ifdef ENABLE_ARCHIVE
+
+#ifndef ENABLE_LINK_CRC
+#error ENABLE_ARCHIVE needs ENABLE_LINK_CRC (the ground tells the blocks from the packets by the CRC)
+#endif // !ENABLE_LINK_CRC
+
+// A record of the archive: the packed fields of every level of the cascade,
+// each followed by its range code (see archive.h). bld/Makefile.options
+// works out ARCHIVE_VALUES as a literal number, for the default block size.
+#ifdef ENABLE_AUTORANGE
+#define ARCHIVE_LEVEL_VALUES (PKT_NUM_FIELDS + 1)
+#else // !ENABLE_AUTORANGE
+#define ARCHIVE_LEVEL_VALUES PKT_NUM_FIELDS
+#endif // !ENABLE_AUTORANGE
+
+_Static_assert(ARCHIVE_VALUES == NUM_WINDOWS * ARCHIVE_LEVEL_VALUES,
+               "ARCHIVE_VALUES must be the values of a record");
+_Static_assert(ARCHIVE_HDR_SIZE + ARCHIVE_RECORD_MAX(ARCHIVE_VALUES) <= ARCHIVE_BLOCK_SIZE,
+               "ARCHIVE_BLOCK_SIZE must hold a record");
+
+typedef struct {
+    int16_t v[ARCHIVE_VALUES];
+} archive_rec_t;
+
+/* The archive state, the last record (the reference for the next one) and
+   the next block to downlink */
+struct msg_archive {
+    CHAN_FIELD(archive_t, archive);
+    CHAN_FIELD(archive_rec_t, last);
+    CHAN_FIELD(uint16_t, next);
+};
+
+struct msg_self_archive {
+    SELF_CHAN_FIELD(archive_t, archive);
+    SELF_CHAN_FIELD(archive_rec_t, last);
+    SELF_CHAN_FIELD(uint16_t, next);
+};
+#define FIELD_INIT_msg_self_archive { \
+    SELF_FIELD_INITIALIZER, \
+    SELF_FIELD_INITIALIZER, \
+    SELF_FIELD_INITIALIZER \
+}
+
+/* Whether task_send left the link unused in this run of the cascade */
+struct msg_spare {
+    CHAN_FIELD(bool, spare);
+};
+
+#endif // ENABLE_ARCHIVE
+
+#ifdef ENABLE_SPECTRUM
+
+struct msg_accel {
+    CHAN_FIELD(spectrum_in_t, accel);
+};
+
+struct msg_spectrum_index {
+    CHAN_FIELD(unsigned, n);
+};
+
+struct msg_self_spectrum {
+    SELF_CHAN_FIELD_ARRAY(spectrum_bin_t, bins, SPECTRUM_BINS);
+    SELF_CHAN_FIELD(spectrum_in_t, pivot);
+    SELF_CHAN_FIELD(unsigned, n);
+};
+#define FIELD_INIT_msg_self_spectrum { \
+    SELF_FIELD_ARRAY_INITIALIZER(SPECTRUM_BINS), \
+    SELF_FIELD_INITIALIZER, \
+    SELF_FIELD_INITIALIZER \
+}
+
+struct msg_spectrum_batch {
+    CHAN_FIELD_ARRAY(spectrum_bin_t, bins, SPECTRUM_BINS);
+};
+
+struct msg_peaks_seq {
+    CHAN_FIELD(unsigned, seq);
+};
+
+struct msg_self_peaks_seq {
+    SELF_CHAN_FIELD(unsigned, seq);
+};
+#define FIELD_INIT_msg_self_peaks_seq { \
+    SELF_FIELD_INITIALIZER \
+}
+
+struct msg_peaks {
+    CHAN_FIELD(pkt_peaks_t, peaks);
+};
+
+#endif // ENABLE_SPECTRUM
 
 TASK(1, task_init)
 TASK(2, task_sample)
@@ -175,9 +714,24 @@ TASK(5, task_update_window)
 TASK(6, task_output)
 TASK(7, task_pack)
 TASK(8, task_send)
+#ifdef ENABLE_SPECTRUM
+TASK(9, task_spectrum)
+TASK(10, task_spectrum_peaks)
+#endif // ENABLE_SPECTRUM
+#ifdef ENABLE_DOUBLE_BUFFER
+TASK(11, task_schedule)
+#endif // ENABLE_DOUBLE_BUFFER
+#ifdef ENABLE_ARCHIVE
+TASK(12, task_archive)
+#endif // ENABLE_ARCHIVE
 
 /*Channels to window*/
 CHANNEL(task_sample, task_window, msg_sample);
+CHANNEL(task_init, task_sample, msg_sample_state);
+SELF_CHANNEL(task_sample, msg_self_sample_state);
+#ifdef ENABLE_MAG_CAL
+CHANNEL(task_sample, task_pack, msg_mag_cal);
+#endif // ENABLE_MAG_CAL
 
 CHANNEL(task_init, task_window, msg_index);
 SELF_CHANNEL(task_window, msg_self_index);
@@ -185,16 +739,63 @@ CHANNEL(task_window, task_update_window, msg_sample_windows);
 
 /*Window channels to update_window_start*/
 CHANNEL(task_init, task_update_window_start, msg_sample_window);
+#ifdef ENABLE_DOUBLE_BUFFER
+CHANNEL(task_window, task_update_window_start, msg_sample_buffers);
+#else // !ENABLE_DOUBLE_BUFFER
 CHANNEL(task_window, task_update_window_start, msg_sample_window);
+#endif // !ENABLE_DOUBLE_BUFFER
+#ifndef ENABLE_EMA_CASCADE
 CHANNEL(task_update_window, task_update_window_start, msg_sample_window);
+#endif // !ENABLE_EMA_CASCADE
 CHANNEL(task_update_window_start, task_update_window, msg_sample_avg_out);
 
 /*Windows channels to task_update_window*/
 SELF_CHANNEL(task_update_window, msg_self_sample_windows);
+#ifndef ENABLE_EMA_CASCADE
 CHANNEL(task_init, task_update_window, msg_sample_windows);
+#endif // !ENABLE_EMA_CASCADE
 
+#ifdef ENABLE_ARCHIVE
+MULTICAST_CHANNEL(msg_window_averages, out, task_update_window, task_output, task_pack, task_archive);
+#else // !ENABLE_ARCHIVE
 MULTICAST_CHANNEL(msg_window_averages, out, task_update_window, task_output, task_pack);
+#endif // !ENABLE_ARCHIVE
+#ifdef PKT_FLAGS
 CHANNEL(task_pack, task_send, msg_pkt);
+#endif // PKT_FLAGS
+#ifdef ENABLE_TXQ
+CHANNEL(task_init, task_send, msg_txq);
+SELF_CHANNEL(task_send, msg_self_txq);
+#endif // ENABLE_TXQ
+#ifdef ENABLE_SPECTRUM
+CHANNEL(task_sample, task_spectrum, msg_accel);
+CHANNEL(task_init, task_spectrum, msg_spectrum_index);
+SELF_CHANNEL(task_spectrum, msg_self_spectrum);
+CHANNEL(task_spectrum, task_spectrum_peaks, msg_spectrum_batch);
+CHANNEL(task_init, task_spectrum_peaks, msg_peaks_seq);
+SELF_CHANNEL(task_spectrum_peaks, msg_self_peaks_seq);
+CHANNEL(task_spectrum_peaks, task_pack, msg_peaks);
+#endif // ENABLE_SPECTRUM
+#ifdef PACK_INIT
+CHANNEL(task_init, task_pack, msg_pack_init);
+#endif // PACK_INIT
+#ifdef PACK_SELF
+SELF_CHANNEL(task_pack, msg_self_pack);
+#endif // PACK_SELF
+#ifdef ENABLE_DOUBLE_BUFFER
+CHANNEL(task_init, task_schedule, msg_schedule);
+CHANNEL(task_window, task_schedule, msg_filled);
+SELF_CHANNEL(task_schedule, msg_self_schedule);
+CHANNEL(task_schedule, task_update_window_start, msg_buffer);
+#ifdef ENABLE_JIT_COALESCE
+CHANNEL(task_update_window, task_schedule, msg_stage);
+#endif // ENABLE_JIT_COALESCE
+#endif // ENABLE_DOUBLE_BUFFER
+#ifdef ENABLE_ARCHIVE
+CHANNEL(task_init, task_archive, msg_archive);
+SELF_CHANNEL(task_archive, msg_self_archive);
+CHANNEL(task_send, task_archive, msg_spare);
+#endif // ENABLE_ARCHIVE
 
 #define WATCHPOINT_BOOT                 0
 #define WATCHPOINT_SAMPLE               1
@@ -202,34 +803,6 @@ CHANNEL(task_pack, task_send, msg_pkt);
 #define WATCHPOINT_UPDATE_WINDOW_START  3
 #define WATCHPOINT_OUTPUT               4
 
-void i2c_setup(void) {
-  /*
-  * Select Port 1
-  * Set Pin 6, 7 to input Secondary Module Function:
-  *   (UCB0SIMO/UCB0SDA, UCB0SOMI/UCB0SCL)
-  */
-
-
-  GPIO_setAsPeripheralModuleFunctionInputPin(
-    GPIO_PORT_P1,
-    GPIO_PIN6 + GPIO_PIN7,
-    GPIO_SECONDARY_MODULE_FUNCTION
-  );
-
-
-
-  EUSCI_B_I2C_initMasterParam param = {0};
-  param.selectClockSource = EUSCI_B_I2C_CLOCKSOURCE_SMCLK;
-  param.i2cClk = CS_getSMCLK();
-  param.dataRate = EUSCI_B_I2C_SET_DATA_RATE_100KBPS;
-  param.byteCounterThreshold = 0;
-  param.autoSTOPGeneration = EUSCI_B_I2C_NO_AUTO_STOP;
-
-  EUSCI_B_I2C_initMaster(EUSCI_B0_BASE, &param);
-  
-
-}
-
 static void delay(uint32_t cycles)
 {
     unsigned i;
@@ -237,6 +810,10 @@ static void delay(uint32_t cycles)
         __delay_cycles(1U << 15);
 }
 
+#ifdef ENABLE_BENCH
+static void bench_kernels(void);
+#endif // ENABLE_BENCH
+
 void initializeHardware()
 {
     msp_watchdog_disable();
@@ -250,7 +827,12 @@ void initializeHardware()
     GPIO(PORT_DBG_0, OUT) |= BIT(PIN_DBG_0);
 
     __enable_interrupt();
+#ifndef ENABLE_BENCH // no harvester to wait for
     harvest_charge();
+#endif // !ENABLE_BENCH
+#ifdef ENABLE_JIT_COALESCE
+    energy_init();
+#endif // ENABLE_JIT_COALESCE
 
     GPIO(PORT_DBG_0, OUT) &= ~BIT(PIN_DBG_0);
 
@@ -270,6 +852,19 @@ void initializeHardware()
 
     msp_clock_setup();
 
+#ifdef ENABLE_BENCH
+    bench_init();
+    bench_kernels();
+#endif // ENABLE_BENCH
+
+#ifdef ENABLE_SAMPLE_CLOCK
+    sample_clock_init();
+#endif // ENABLE_SAMPLE_CLOCK
+
+#ifdef ENABLE_UART_DMA
+    uartdma_resume();
+#endif // ENABLE_UART_DMA
+
 #ifdef CONFIG_EDB
     edb_init();
 #endif
@@ -283,30 +878,64 @@ void initializeHardware()
     LOG("i2c init\r\n");
     i2c_setup();
 
+#ifdef ENABLE_WARM_BOOT
+    // Warm boot: if only the MCU lost power, the sensors are still
+    // configured, and a register readback replaces the full init (ID reads,
+    // register writes, and the 50ms settle of the magnetometer).
+    mag_warm = mag_configured && magnetometer_check();
+    bool lsm_warm = lsm_configured && lsm_check();
+    LOG("warm boot: mag %u LSM %u\r\n", mag_warm, lsm_warm);
+
+    if (mag_warm) {
+      mag_ok = true;
+    } else {
+      mag_configured = false;
+      LOG("mag init\r\n");
+      mag_ok = magnetometer_init();
+      mag_configured = mag_ok;
+    }
+
+    if (lsm_warm) {
+      lsm_ok = true;
+    } else {
+      lsm_configured = false;
+      LOG("LSM init\r\n");
+      lsm_ok = lsm_init();
+      lsm_configured = lsm_ok;
+    }
+#else // !ENABLE_WARM_BOOT
     LOG("mag init\r\n");
     mag_ok = magnetometer_init();
 
     LOG("LSM init\r\n");
     lsm_ok = lsm_init();
+#endif // !ENABLE_WARM_BOOT
 
     LOG("space app: curtsk %u\r\n", curctx->task->idx);
+#ifdef ENABLE_WARM_BOOT
+    TRACE_BOOT(curctx->task->idx, mag_ok, lsm_ok, mag_warm, lsm_warm);
+#else // !ENABLE_WARM_BOOT
+    TRACE_BOOT(curctx->task->idx, mag_ok, lsm_ok, false, false);
+#endif // !ENABLE_WARM_BOOT
 }
 
-void print_sample(samp_t *s) {
-  LOG("{T:%i,"
-      "M:{%i,%i,%i},"
-      "A:{%i,%i,%i},"
-#ifdef ENABLE_GYRO
-      "G:{%i,%i,%i}"
-#endif // ENABLE_GYRO
-      "}\r\n",
-      s->temp,
-      s->mx,s->my,s->mz,
-      s->ax, s->ay, s->az
-#ifdef ENABLE_GYRO
-      ,s->gx, s->gy, s->gz
-#endif // ENABLE_GYRO
-      );
+void print_sample(const samp_t *s) {
+  LOG("{");
+  for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+    LOG("%s:%i,", pkt_field_name(f), s->v[f]);
+#ifdef ENABLE_SAMPLE_CLOCK
+  LOG("t:%u,", s->tick);
+#endif // ENABLE_SAMPLE_CLOCK
+#ifdef ENABLE_AUTORANGE
+  LOG("r:%02x", s->range);
+#endif // ENABLE_AUTORANGE
+  LOG("}\r\n");
+}
+
+void print_win(const pkt_win_t *win) {
+  for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+    LOG("%s %i ", pkt_field_name(f), win->v[f]);
+  LOG("\r\n");
 }
 
 
@@ -321,37 +950,105 @@ void print_sample(samp_t *s) {
 */
 void task_init()
 {
+    BENCH_TASK(task_init);
     LOG("Space Data App Initializing\r\n");
 
-    unsigned i;
     int zero = 0;
     bool vtrue = true;
+#ifndef ENABLE_EMA_CASCADE
+    unsigned i;
     for( i = 0; i < NUM_WINDOWS; i++ ){
       /*Zero every window's win_i*/
       CHAN_OUT1(int, win_i[i], zero, CH(task_init, task_update_window));
     }
 
     CHAN_OUT1(int, which_window, zero, CH(task_init, task_update_window));
+#endif // !ENABLE_EMA_CASCADE
     CHAN_OUT1(int, i, zero, CH(task_init, task_window));
     CHAN_OUT1(int, first_window, vtrue, CH(task_init, task_window));
 
+#ifdef ENABLE_DOUBLE_BUFFER
+    unsigned none = 0, idle = CASCADE_STAGES;
+    CHAN_OUT1(unsigned, filled, none, CH(task_init, task_window));
+    CHAN_OUT1(unsigned, filled, none, CH(task_init, task_schedule));
+    CHAN_OUT1(unsigned, started, none, CH(task_init, task_schedule));
+    CHAN_OUT1(unsigned, stage, idle, CH(task_init, task_schedule));
+#ifndef ENABLE_SAMPLE_CLOCK
+    bool vfalse = false;
+    CHAN_OUT1(bool, ran, vfalse, CH(task_init, task_schedule));
+#endif // !ENABLE_SAMPLE_CLOCK
+#endif // ENABLE_DOUBLE_BUFFER
+
+#ifdef ENABLE_TXQ
+    txq_meta_t empty = { 0, 0 };
+    unsigned uzero = 0;
+    for (unsigned e = 0; e < TXQ_SIZE; ++e)
+      CHAN_OUT1(txq_meta_t, meta[e], empty, CH(task_init, task_send));
+    CHAN_OUT1(uint16_t, seq, uzero, CH(task_init, task_send));
+    CHAN_OUT1(unsigned, cycle, uzero, CH(task_init, task_send));
+#endif // ENABLE_TXQ
+
+#ifdef ENABLE_SPECTRUM
+    // Batch count 0 is the empty report, until the first batch is done
+    unsigned n_zero = 0, seq_one = 1;
+    pkt_peaks_t no_peaks = { 0 };
+    CHAN_OUT1(unsigned, n, n_zero, CH(task_init, task_spectrum));
+    CHAN_OUT1(unsigned, seq, seq_one, CH(task_init, task_spectrum_peaks));
+    CHAN_OUT1(pkt_peaks_t, peaks, no_peaks, CH(task_init, task_pack));
+#endif // ENABLE_SPECTRUM
+
+#ifdef ENABLE_TX_SUPPRESS
+    // The first packet is a keyframe
+    unsigned unsent = TX_KEYFRAME_INTERVAL - 1;
+    CHAN_OUT1(unsigned, unsent, unsent, CH(task_init, task_pack));
+#endif // ENABLE_TX_SUPPRESS
+
+#ifdef ENABLE_LINK_BUDGET
+    // Start from the whole packet
+    unsigned budget = PKT_BUDGET_MAX;
+    CHAN_OUT1(unsigned, budget, budget, CH(task_init, task_pack));
+    pack_powered = true;
+#endif // ENABLE_LINK_BUDGET
+
+    sample_state_t sample_state = { { 0 } };
+#ifdef ENABLE_MAG_CAL
+    magcal_init(&sample_state.magcal);
+#endif // ENABLE_MAG_CAL
+#ifdef ENABLE_AUTORANGE
+    autorange_init(&sample_state.autorange);
+#endif // ENABLE_AUTORANGE
+#ifdef ENABLE_POWER_MODES
+    powermode_init(&sample_state.power);
+#endif // ENABLE_POWER_MODES
+    CHAN_OUT1(sample_state_t, state, sample_state, CH(task_init, task_sample));
+
+#ifdef ENABLE_MAG_CAL
+    unsigned cal_axis = 0;
+    CHAN_OUT1(unsigned, cal_axis, cal_axis, CH(task_init, task_pack));
+#endif // ENABLE_MAG_CAL
+
+#ifdef ENABLE_ARCHIVE
+    archive_t archive = { 0 };
+    archive_rec_t no_rec = { { 0 } };
+    uint16_t first_block = 0;
+    CHAN_OUT1(archive_t, archive, archive, CH(task_init, task_archive));
+    CHAN_OUT1(archive_rec_t, last, no_rec, CH(task_init, task_archive));
+    CHAN_OUT1(uint16_t, next, first_block, CH(task_init, task_archive));
+#endif // ENABLE_ARCHIVE
+
     TRANSITION_TO(task_sample);
 }
 
-void read_mag(int *x,
-              int *y,
-              int *z){
-  magnet_t co;
-  if (mag_ok) {
-    magnetometer_read(&co);
-    *x = co.x;
-    *y = co.y;
-    *z = co.z;
-  } else {
-    *x = 0;
-    *y = 0;
-    *z = 0;
-  }
+/* Takes a reading into *m if the measurement is due; returns false, and
+   the sample falls back to the last reading (zero if none), when the
+   magnetometer is absent or the read fails, or when it is not due */
+static bool read_mag(magnet_t *m, bool due){
+  if (!mag_ok || !due)
+    return false;
+
+  int rc = magnetometer_read(m);
+  TRACE_MAG(rc, m);
+  return rc == I2C_OK;
 }
 
 /*Collect the next temperature sample
@@ -364,33 +1061,209 @@ void read_mag(int *x,
       task_window
 */
 void task_sample(){
+  BENCH_TASK(task_sample);
   
   LOG("task sample\r\n");
 
-  WATCHPOINT(WATCHPOINT_SAMPLE);
+#ifdef ENABLE_SAMPLE_CLOCK
+  // Idle until the next sampling instant. Everything else in the
+  // chain runs back-to-back between two ticks.
+  sample_tick_t tick = sample_clock_wait();
+#endif // ENABLE_SAMPLE_CLOCK
 
-  samp_t sample;
-  sample.temp = read_temperature_sensor();
+  WATCHPOINT(WATCHPOINT_SAMPLE);
 
-  read_mag(&(sample.mx),&(sample.my),&(sample.mz));
+  sample_state_t st = *CHAN_IN2(sample_state_t, state, CH(task_init, task_sample),
+                                                       SELF_IN_CH(task_sample));
+
+#if defined(ENABLE_AUTORANGE) || defined(ENABLE_POWER_MODES)
+  if (!sample_powered) {
+#ifdef ENABLE_AUTORANGE
+#ifdef ENABLE_WARM_BOOT
+    autorange_resume(&st.autorange, mag_ok, lsm_ok, mag_warm);
+#else // !ENABLE_WARM_BOOT
+    autorange_resume(&st.autorange, mag_ok, lsm_ok, false);
+#endif // !ENABLE_WARM_BOOT
+#endif // ENABLE_AUTORANGE
+#ifdef ENABLE_POWER_MODES
+    powermode_resume(&st.power, lsm_ok);
+#endif // ENABLE_POWER_MODES
+    sample_powered = true;
+  }
+#endif // ENABLE_AUTORANGE || ENABLE_POWER_MODES
 
-  lsm_sample(&lsm_samp);
+  samp_t sample;
+#ifdef ENABLE_SAMPLE_CLOCK
+  sample.tick = tick;
+#endif // ENABLE_SAMPLE_CLOCK
+#ifdef ENABLE_AUTORANGE
+  sample.range = autorange_code(&st.autorange); // before the readings can change it
+#endif // ENABLE_AUTORANGE
+  sample.v[PKT_F_temp] = read_temperature_sensor();
+  TRACE_TEMP(sample.v[PKT_F_temp]);
+
+#ifdef ENABLE_POWER_MODES
+  bool due = powermode_mag_due(&st.power);
+#else // !ENABLE_POWER_MODES
+  bool due = true;
+#endif // !ENABLE_POWER_MODES
+  magnet_t mag;
+  if (read_mag(&mag, due)) {
+#ifdef ENABLE_AUTORANGE
+    autorange_mag(&st.autorange, &mag);
+#endif // ENABLE_AUTORANGE
+#ifdef ENABLE_MAG_CAL
+    magcal_update(&st.magcal, &mag);
+    magcal_apply(&st.magcal.cal, &mag);
+#endif // ENABLE_MAG_CAL
+    st.mag_last = mag;
+  }
+  sample.v[PKT_F_mx] = st.mag_last.x;
+  sample.v[PKT_F_my] = st.mag_last.y;
+  sample.v[PKT_F_mz] = st.mag_last.z;
+
+  if (lsm_ok) {
+    lsm_t lsm;
+    int rc = lsm_sample(&lsm);
+    TRACE_LSM(rc, &lsm);
+    if (rc == I2C_OK) {
+#ifdef ENABLE_AUTORANGE
+      autorange_lsm(&st.autorange, &lsm);
+#endif // ENABLE_AUTORANGE
+#ifdef ENABLE_POWER_MODES
+      powermode_accel(&st.power, &lsm);
+#endif // ENABLE_POWER_MODES
+      st.lsm_last = lsm;
+    }
+  }
 
-  sample.ax = lsm_samp.ax;
-  sample.ay = lsm_samp.ay;
-  sample.az = lsm_samp.az;
+  sample.v[PKT_F_ax] = st.lsm_last.ax;
+  sample.v[PKT_F_ay] = st.lsm_last.ay;
+  sample.v[PKT_F_az] = st.lsm_last.az;
 #ifdef ENABLE_GYRO
-  sample.gx = lsm_samp.gx;
-  sample.gy = lsm_samp.gy;
-  sample.gz = lsm_samp.gz;
+  sample.v[PKT_F_gx] = st.lsm_last.gx;
+  sample.v[PKT_F_gy] = st.lsm_last.gy;
+  sample.v[PKT_F_gz] = st.lsm_last.gz;
 #endif // ENABLE_GYRO
   
   CHAN_OUT1(samp_t, sample, sample, CH(task_sample, task_window));
   LOG("sampled: "); print_sample(&sample);
+#ifdef ENABLE_MAG_CAL
+  CHAN_OUT1(magcal_cal_t, cal, st.magcal.cal, CH(task_sample, task_pack));
+#endif // ENABLE_MAG_CAL
+  CHAN_OUT1(sample_state_t, state, st, SELF_OUT_CH(task_sample));
+
+#ifdef ENABLE_SPECTRUM
+  spectrum_in_t accel = { { sample.v[PKT_F_ax], sample.v[PKT_F_ay], sample.v[PKT_F_az] } };
+  CHAN_OUT1(spectrum_in_t, accel, accel, CH(task_sample, task_spectrum));
+  TRANSITION_TO(task_spectrum);
+#else // !ENABLE_SPECTRUM
+  TRANSITION_TO(task_window);
+#endif // !ENABLE_SPECTRUM
+}
+
+#ifdef ENABLE_SPECTRUM
+
+/*Update the Goertzel bank with the accel sample (one slice of the batch)
+  Input channels:
+    { unsigned n; spectrum_bin_t bins[]; spectrum_in_t pivot; }
+      self channel: index in the batch and state of the bins
+    { spectrum_in_t accel; }
+      the sample from task_sample
+  Output channels:
+    { spectrum_bin_t bins[] }
+      the final state of the bins, to task_spectrum_peaks, after the last
+      sample of the batch
+  Successors:
+      task_spectrum_peaks after the last sample of a batch, else task_window
+*/
+void task_spectrum()
+{
+  BENCH_TASK(task_spectrum);
+  LOG("task spectrum\r\n");
+
+  unsigned n = *CHAN_IN2(unsigned, n, CH(task_init, task_spectrum),
+                                      SELF_IN_CH(task_spectrum));
+  spectrum_in_t x = *CHAN_IN1(spectrum_in_t, accel, CH(task_sample, task_spectrum));
+
+  // The state starts over with the first sample of a batch, so it is
+  // never read (nor reset) then
+  bool first = n == 0;
+  bool last = n == SPECTRUM_N - 1;
+
+  spectrum_in_t pivot;
+  if (first) {
+    pivot = x;
+    CHAN_OUT1(spectrum_in_t, pivot, pivot, SELF_OUT_CH(task_spectrum));
+  } else {
+    pivot = *CHAN_IN1(spectrum_in_t, pivot, SELF_IN_CH(task_spectrum));
+  }
+
+  for (unsigned b = 0; b < SPECTRUM_BINS; ++b) {
+    spectrum_bin_t bin;
+    if (!first)
+      bin = *CHAN_IN1(spectrum_bin_t, bins[b], SELF_IN_CH(task_spectrum));
+    spectrum_step(&bin, b + 1, &x, &pivot, first);
+    if (last)
+      CHAN_OUT1(spectrum_bin_t, bins[b], bin, CH(task_spectrum, task_spectrum_peaks));
+    else
+      CHAN_OUT1(spectrum_bin_t, bins[b], bin, SELF_OUT_CH(task_spectrum));
+  }
+
+  unsigned next_n = last ? 0 : n + 1;
+  CHAN_OUT1(unsigned, n, next_n, SELF_OUT_CH(task_spectrum));
+
+  if (last)
+    TRANSITION_TO(task_spectrum_peaks);
+  else
+    TRANSITION_TO(task_window);
+}
+
+/*Pick the spectral peaks of the batch that just completed
+  Input channels:
+    { spectrum_bin_t bins[] }
+      the final state of the bins from task_spectrum
+    { unsigned seq; }
+      self channel: count of batches
+  Output channels:
+    { pkt_peaks_t peaks; }
+      the peaks, to task_pack, which sends them until the next batch
+  Successors:
+      task_window
+*/
+void task_spectrum_peaks()
+{
+  BENCH_TASK(task_spectrum_peaks);
+  LOG("task spectrum peaks\r\n");
+
+  uint8_t power[SPECTRUM_BINS];
+  for (unsigned b = 0; b < SPECTRUM_BINS; ++b) {
+    const spectrum_bin_t *bin = CHAN_IN1(spectrum_bin_t, bins[b],
+                                         CH(task_spectrum, task_spectrum_peaks));
+    power[b] = spectrum_power(bin, b + 1);
+  }
+
+  unsigned seq = *CHAN_IN2(unsigned, seq, CH(task_init, task_spectrum_peaks),
+                                          SELF_IN_CH(task_spectrum_peaks));
+
+  pkt_peaks_t peaks;
+  spectrum_peaks(power, &peaks);
+  peaks.seq = seq & ((1 << PKT_PEAKS_SEQ_BITS) - 1);
+
+  LOG("peaks %u:", peaks.seq);
+  for (unsigned i = 0; i < PKT_NUM_PEAKS; ++i)
+    LOG(" %u/%u", peaks.peak[i].bin, peaks.peak[i].power);
+  LOG("\r\n");
+
+  CHAN_OUT1(pkt_peaks_t, peaks, peaks, CH(task_spectrum_peaks, task_pack));
+  ++seq;
+  CHAN_OUT1(unsigned, seq, seq, SELF_OUT_CH(task_spectrum_peaks));
 
   TRANSITION_TO(task_window);
 }
 
+#endif // ENABLE_SPECTRUM
+
 
 /*Report the samples in the window
   Input channels: 
@@ -405,6 +1278,7 @@ void task_sample(){
       task_update_window_start
 */
 void task_window(){
+  BENCH_TASK(task_window);
 
   LOG("task window\r\n");
 
@@ -413,8 +1287,21 @@ void task_window(){
   int i = *CHAN_IN2(int, i, SELF_IN_CH(task_window),
                             CH(task_init, task_window));
 
-  samp_t sample = *CHAN_IN1(samp_t, sample, CH(task_sample, task_window));
-  CHAN_OUT1(samp_t, window[i], sample, CH(task_window, task_update_window_start));
+  BENCH_BEGIN(chan_in_sample);
+  const samp_t *sample = CHAN_IN1(samp_t, sample, CH(task_sample, task_window));
+  BENCH_END(chan_in_sample);
+  BENCH_BEGIN(chan_out_sample);
+#ifdef ENABLE_DOUBLE_BUFFER
+  // Window n fills buffer n % 2
+  unsigned filled = *CHAN_IN2(unsigned, filled, CH(task_init, task_window),
+                                                SELF_IN_CH(task_window));
+  unsigned buf = filled & 1;
+  CHAN_OUT1(samp_t, buffers[buf * WINDOW_SIZE + i], *sample,
+            CH(task_window, task_update_window_start));
+#else // !ENABLE_DOUBLE_BUFFER
+  CHAN_OUT1(samp_t, window[i], *sample, CH(task_window, task_update_window_start));
+#endif // !ENABLE_DOUBLE_BUFFER
+  BENCH_END(chan_out_sample);
   
   int next_i = (i + 1) % WINDOW_SIZE;
   CHAN_OUT1(int, i, next_i, SELF_OUT_CH(task_window));
@@ -428,22 +1315,275 @@ void task_window(){
                                                       SELF_IN_CH(task_window));
     LOG("first window: %u\r\n", first_window);
     if (first_window) {
+#ifdef ENABLE_EMA_CASCADE
+      for (unsigned k = 1; k < NUM_WINDOWS; ++k) {
+        ema_t ema;
+        for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+          ema.v[f] = (long)sample->v[f] * (1L << EMA_SHIFT(k));
+        CHAN_OUT1(ema_t, ema[k], ema, CH(task_window, task_update_window));
+      }
+#else // !ENABLE_EMA_CASCADE
       for (unsigned which_window = 0; which_window < NUM_WINDOWS; ++which_window) {
           for( i = 0; i < WINDOW_SIZE; i++ ){
-            CHAN_OUT1(samp_t, windows[WINGET(which_window,i)], sample, CH(task_window, task_update_window));
+            CHAN_OUT1(samp_t, windows[WINGET(which_window,i)], *sample, CH(task_window, task_update_window));
           }
       }
+#endif // !ENABLE_EMA_CASCADE
       first_window = !first_window;
       CHAN_OUT1(bool, first_window, first_window, SELF_OUT_CH(task_window));
     }
 
+#ifdef ENABLE_DOUBLE_BUFFER
+    // Hand the window off, and go on with the other buffer
+    ++filled;
+    CHAN_OUT1(unsigned, filled, filled, SELF_OUT_CH(task_window));
+    CHAN_OUT1(unsigned, filled, filled, CH(task_window, task_schedule));
+    TRANSITION_TO(task_schedule);
+#else // !ENABLE_DOUBLE_BUFFER
     TRANSITION_TO(task_update_window_start);
+#endif // !ENABLE_DOUBLE_BUFFER
   }else{
+#ifdef ENABLE_DOUBLE_BUFFER
+    TRANSITION_TO(task_schedule);
+#else // !ENABLE_DOUBLE_BUFFER
     TRANSITION_TO(task_sample);
+#endif // !ENABLE_DOUBLE_BUFFER
   }
 
 }
 
+#ifdef ENABLE_DOUBLE_BUFFER
+
+/* The task of a step (see CASCADE_STAGES) */
+static task_t *cascade_stage(unsigned stage)
+{
+  if (stage < 2 * CASCADE_PASSES)
+    return (stage & 1) ? TASK_REF(task_update_window) : TASK_REF(task_update_window_start);
+#ifdef ENABLE_ARCHIVE
+  if (stage == CASCADE_STAGES - 1)
+    return TASK_REF(task_archive);
+#endif // ENABLE_ARCHIVE
+  if (stage == CASCADE_STAGES - 1 - CASCADE_ARCHIVE_STAGES)
+    return TASK_REF(task_send);
+  if (stage == CASCADE_STAGES - 2 - CASCADE_ARCHIVE_STAGES)
+    return TASK_REF(task_pack);
+  return TASK_REF(task_output);
+}
+
+/* Whether to take the next sample now rather than run another step */
+#ifdef ENABLE_SAMPLE_CLOCK
+#define SCHEDULE_YIELD() sample_clock_pending()
+#else // !ENABLE_SAMPLE_CLOCK
+#define SCHEDULE_YIELD() ran
+#endif // !ENABLE_SAMPLE_CLOCK
+
+/*Interleave the cascade with the sampling of the next window
+  Input channels:
+    { unsigned filled; }
+      count of windows that task_window handed off
+    { unsigned started; unsigned stage; }
+      self channel: count of windows that the cascade took, and its next
+      step (CASCADE_STAGES when done)
+    { unsigned stage; }
+      with ENABLE_JIT_COALESCE, the next step after a run of
+      task_update_window that did several levels
+  Output channels:
+    { int buf; }
+      the buffer of the window, to the first step
+  Successors:
+      the next step of the cascade, or task_sample
+
+  The steps run in the gaps between samples: while no sample is due (with
+  the sample clock), or one step per sample (without it). The window that
+  the cascade reads is taken in its first step, which runs as soon as the
+  window is handed off, so that its buffer is free for the window after
+  next. If another window fills before the cascade is done, the cascade
+  runs to the end without sampling (a gap in the samples, as without
+  double buffering).
+*/
+void task_schedule()
+{
+  BENCH_TASK(task_schedule);
+
+  LOG("task schedule\r\n");
+
+  unsigned filled = *CHAN_IN2(unsigned, filled, CH(task_init, task_schedule),
+                                                CH(task_window, task_schedule));
+  unsigned started = *CHAN_IN2(unsigned, started, CH(task_init, task_schedule),
+                                                  SELF_IN_CH(task_schedule));
+#ifdef ENABLE_JIT_COALESCE
+  unsigned stage = *CHAN_IN3(unsigned, stage, CH(task_init, task_schedule),
+                                              SELF_IN_CH(task_schedule),
+                                              CH(task_update_window, task_schedule));
+#else // !ENABLE_JIT_COALESCE
+  unsigned stage = *CHAN_IN2(unsigned, stage, CH(task_init, task_schedule),
+                                              SELF_IN_CH(task_schedule));
+#endif // !ENABLE_JIT_COALESCE
+#ifndef ENABLE_SAMPLE_CLOCK
+  bool ran = *CHAN_IN2(bool, ran, CH(task_init, task_schedule),
+                                  SELF_IN_CH(task_schedule));
+#endif // !ENABLE_SAMPLE_CLOCK
+
+  bool take = stage == CASCADE_STAGES && filled != started;
+  bool overrun = stage != CASCADE_STAGES && filled != started;
+
+  if (take) {
+    int buf = started & 1; // window 'started' is in buffer started % 2
+    ++started;
+    stage = 0;
+    CHAN_OUT1(unsigned, started, started, SELF_OUT_CH(task_schedule));
+    CHAN_OUT1(int, buf, buf, CH(task_schedule, task_update_window_start));
+  } else if (stage == CASCADE_STAGES || (!overrun && SCHEDULE_YIELD())) {
+    LOG("schedule: sample (stage %u)\r\n", stage);
+#ifndef ENABLE_SAMPLE_CLOCK
+    bool vfalse = false;
+    CHAN_OUT1(bool, ran, vfalse, SELF_OUT_CH(task_schedule));
+#endif // !ENABLE_SAMPLE_CLOCK
+    TRANSITION_TO(task_sample);
+  } else if (cascade_stage(stage) == TASK_REF(task_update_window_start)) {
+    int none = -1; // the levels above the first read the windows of averages
+    CHAN_OUT1(int, buf, none, CH(task_schedule, task_update_window_start));
+  }
+
+  LOG("schedule: stage %u\r\n", stage);
+  task_t *next = cascade_stage(stage);
+  ++stage;
+  CHAN_OUT1(unsigned, stage, stage, SELF_OUT_CH(task_schedule));
+#ifndef ENABLE_SAMPLE_CLOCK
+  bool vtrue = true;
+  CHAN_OUT1(bool, ran, vtrue, SELF_OUT_CH(task_schedule));
+#endif // !ENABLE_SAMPLE_CLOCK
+  transition_to(next);
+}
+
+#endif // ENABLE_DOUBLE_BUFFER
+
+// Single-pass statistics of one field over a window. The mean comes from
+// the exact sum. For the variance, the values are shifted down to at most
+// STAT_BITS and accumulated relative to the first one (the pivot): the sums
+// then fit in 32 bits, and, since the pivot is close to the mean, the
+// rounding of the mean doesn't swamp a small variance. (This is the
+// shifted-data form of the one-pass variance; unlike Welford's update it
+// needs no division per sample, which we can't afford without a divider.)
+typedef struct {
+  long sum;
+#ifdef ENABLE_WINDOW_STATS
+  int min, max;
+  int pivot;
+  long sum_d;
+  unsigned long sum_d2;
+#endif // ENABLE_WINDOW_STATS
+} stat_t;
+
+#if defined(ENABLE_WINDOW_STATS) && WINDOW_SIZE > 16
+#error Variance accumulator may overflow: WINDOW_SIZE must be <= 16
+#endif
+
+static inline void stat_add(stat_t *st, int x, unsigned shift, bool first)
+{
+#ifdef ENABLE_WINDOW_STATS
+  int v = x >> shift;
+  if (first) {
+    st->sum = 0;
+    st->min = x;
+    st->max = x;
+    st->pivot = v;
+    st->sum_d = 0;
+    st->sum_d2 = 0;
+  }
+
+  if (x < st->min)
+    st->min = x;
+  if (x > st->max)
+    st->max = x;
+
+  int d = v - st->pivot;
+  st->sum_d += d;
+  st->sum_d2 += (long)d * d;
+#else // !ENABLE_WINDOW_STATS
+  if (first)
+    st->sum = 0;
+#endif // !ENABLE_WINDOW_STATS
+
+  st->sum += x;
+}
+
+#ifdef ENABLE_WINDOW_STATS
+/* Returns the bit length of the variance in sensor units (0 if var < 1) */
+static inline int stat_lvar(const stat_t *st, unsigned shift)
+{
+  long mean_d = st->sum_d / WINDOW_SIZE;
+  long var = (long)(st->sum_d2 / WINDOW_SIZE) - mean_d * mean_d;
+
+  int lvar = 0;
+  while (var > 0) {
+    ++lvar;
+    var >>= 1;
+  }
+  return lvar ? lvar + 2 * shift : 0;
+}
+#endif // ENABLE_WINDOW_STATS
+
+// A window averaged, with its statistics (ENABLE_WINDOW_STATS): what
+// task_update_window_start hands to task_update_window for a level
+typedef struct {
+  samp_t avg;
+#ifdef ENABLE_WINDOW_STATS
+  samp_stats_t stats;
+#endif // ENABLE_WINDOW_STATS
+} win_avg_t;
+
+/* Averages the window of WINDOW_SIZE samples into *res (which may be where
+   one of them is) */
+static void average_window(win_avg_t *res, const samp_t *const window[])
+{
+  stat_t st[PKT_NUM_FIELDS];
+
+  samp_t avg;
+
+  for(unsigned j = 0; j < WINDOW_SIZE; j++){
+      const samp_t *sample = window[j];
+#ifdef ENABLE_SAMPLE_CLOCK
+      if (j == 0 || (sample_tick_t)(sample->tick - avg.tick) < 0x8000)
+        avg.tick = sample->tick; // latest, modulo wraparound
+#endif // ENABLE_SAMPLE_CLOCK
+#ifdef ENABLE_AUTORANGE
+      avg.range = j == 0 ? sample->range : autorange_merge(avg.range, sample->range);
+#endif // ENABLE_AUTORANGE
+
+      for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+        stat_add(&st[f], sample->v[f], STAT_SHIFT(pkt_field_sbits(f)), j == 0);
+  }
+  LOG("sum done\r\n");
+
+  for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+    avg.v[f] = st[f].sum / WINDOW_SIZE;
+
+#ifdef ENABLE_WINDOW_STATS
+  samp_stats_t stats;
+  for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f) {
+    stats.min.v[f] = st[f].min;
+    stats.max.v[f] = st[f].max;
+    stats.lvar.v[f] = stat_lvar(&st[f], STAT_SHIFT(pkt_field_sbits(f)));
+  }
+#ifdef ENABLE_SAMPLE_CLOCK
+  stats.min.tick = stats.max.tick = stats.lvar.tick = avg.tick;
+#endif // ENABLE_SAMPLE_CLOCK
+#ifdef ENABLE_AUTORANGE
+  stats.min.range = stats.max.range = stats.lvar.range = avg.range;
+#endif // ENABLE_AUTORANGE
+#endif // ENABLE_WINDOW_STATS
+
+  LOG("avg: "); print_sample(&avg);
+  res->avg = avg;
+#ifdef ENABLE_WINDOW_STATS
+  LOG("min: "); print_sample(&stats.min);
+  LOG("max: "); print_sample(&stats.max);
+  LOG("lvar: "); print_sample(&stats.lvar);
+  res->stats = stats;
+#endif // ENABLE_WINDOW_STATS
+}
+
 /*Report the samples in the window
   Input channels: 
     { int window[TEMP_WINDOW_SIZE]; }
@@ -454,326 +1594,925 @@ void task_window(){
       task_sample
 */
 void task_update_window_start(){
+  BENCH_TASK(task_update_window_start);
 
   LOG("task update_window_start\r\n");
 
   WATCHPOINT(WATCHPOINT_UPDATE_WINDOW_START);
 
-  // not samp_t because need 32-bit to prevent overflow
-  long sum_temp = 0;
-  long sum_mx = 0, sum_my = 0, sum_mz = 0;
-  long sum_ax = 0, sum_ay = 0, sum_az = 0;
-#ifdef ENABLE_GYRO
-  long sum_gx = 0, sum_gy = 0, sum_gz = 0;
-#endif // ENABLE_GYRO
+  const samp_t *samples[WINDOW_SIZE];
 
-  samp_t avg;
+#ifdef ENABLE_DOUBLE_BUFFER
+  int buf = *CHAN_IN1(int, buf, CH(task_schedule, task_update_window_start));
+#endif // ENABLE_DOUBLE_BUFFER
 
   for(unsigned j = 0; j < WINDOW_SIZE; j++){
 
-      samp_t sample = *CHAN_IN2(samp_t, window[j], CH(task_window, task_update_window_start),
-                                                   CH(task_update_window, task_update_window_start));
-      sum_temp += sample.temp;
+#ifdef ENABLE_DOUBLE_BUFFER
+#ifndef ENABLE_EMA_CASCADE
+      if (buf < 0)
+        samples[j] = CHAN_IN1(samp_t, window[j], CH(task_update_window, task_update_window_start));
+      else
+#endif // !ENABLE_EMA_CASCADE
+        samples[j] = CHAN_IN1(samp_t, buffers[buf * WINDOW_SIZE + j],
+                              CH(task_window, task_update_window_start));
+#elif defined(ENABLE_EMA_CASCADE)
+      samples[j] = CHAN_IN1(samp_t, window[j], CH(task_window, task_update_window_start));
+#else // !ENABLE_EMA_CASCADE
+      samples[j] = CHAN_IN2(samp_t, window[j], CH(task_window, task_update_window_start),
+                                               CH(task_update_window, task_update_window_start));
+#endif // !ENABLE_EMA_CASCADE
+  }
 
-      sum_mx += sample.mx;
-      sum_my += sample.my;
-      sum_mz += sample.mz;
+  win_avg_t res;
+  average_window(&res, samples);
 
-      sum_ax += sample.ax;
-      sum_ay += sample.ay;
-      sum_az += sample.az;
+  CHAN_OUT1(samp_t, average, res.avg, CH(task_update_window_start,task_update_window));
+#ifdef ENABLE_WINDOW_STATS
+  CHAN_OUT1(samp_stats_t, stats, res.stats, CH(task_update_window_start,task_update_window));
+#endif // ENABLE_WINDOW_STATS
 
-#ifdef ENABLE_GYRO
-      sum_gx += sample.gx;
-      sum_gy += sample.gy;
-      sum_gz += sample.gz;
-#endif // ENABLE_GYRO
-  }
-  LOG("sum done\r\n");
+  CASCADE_NEXT(task_update_window);
+}
 
-  avg.temp = sum_temp / WINDOW_SIZE;
-  avg.mx = sum_mx / WINDOW_SIZE;
-  avg.my = sum_my / WINDOW_SIZE;
-  avg.mz = sum_mz / WINDOW_SIZE;
+#ifdef ENABLE_EMA_CASCADE
 
-  avg.ax = sum_ax / WINDOW_SIZE;
-  avg.ay = sum_ay / WINDOW_SIZE;
-  avg.az = sum_az / WINDOW_SIZE;
+/* Level 0 is the plain average of the window of samples; every other level
+   is updated in constant time from it: S += avg - S/2^n, where S is the
+   level's average scaled by 2^n. */
+void task_update_window(){
+  BENCH_TASK(task_update_window);
 
-#ifdef ENABLE_GYRO
-  avg.gx = sum_gx / WINDOW_SIZE;
-  avg.gy = sum_gy / WINDOW_SIZE;
-  avg.gz = sum_gz / WINDOW_SIZE;
-#endif // ENABLE_GYRO
+  LOG("task update_window (ema)\r\n");
 
-  LOG("avg: "); print_sample(&avg);
+  const samp_t *avg = CHAN_IN1(samp_t, average, CH(task_update_window_start, task_update_window));
 
-  CHAN_OUT1(samp_t, average, avg, CH(task_update_window_start,task_update_window));
+  CHAN_OUT1(samp_t, win_avg[0], *avg,
+            MC_OUT_CH(out, task_update_window, task_output, task_pack));
+#ifdef ENABLE_WINDOW_STATS
+  // Only level 0 is a window of samples, so only it has statistics
+  const samp_stats_t *stats = CHAN_IN1(samp_stats_t, stats,
+                                       CH(task_update_window_start, task_update_window));
+  CHAN_OUT1(samp_stats_t, win_stats[0], *stats,
+            MC_OUT_CH(out, task_update_window, task_output, task_pack));
+#endif // ENABLE_WINDOW_STATS
 
-  TRANSITION_TO(task_update_window);
-}
+  for (unsigned k = 1; k < NUM_WINDOWS; ++k) {
+    ema_t ema = *CHAN_IN2(ema_t, ema[k], CH(task_window, task_update_window),
+                                         SELF_IN_CH(task_update_window));
+    samp_t level_avg = *avg;
 
-void task_update_window(){
+    for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f) {
+      ema.v[f] += avg->v[f] - (ema.v[f] >> EMA_SHIFT(k));
+      level_avg.v[f] = ema.v[f] >> EMA_SHIFT(k);
+    }
 
-  LOG("task update_window\r\n");
+    CHAN_OUT1(ema_t, ema[k], ema, SELF_OUT_CH(task_update_window));
+    CHAN_OUT1(samp_t, win_avg[k], level_avg,
+              MC_OUT_CH(out, task_update_window, task_output, task_pack));
 
-  /*Get the average and window ID from the averaging call*/
-  samp_t avg = *CHAN_IN1(samp_t, average, CH(task_update_window_start, task_update_window));
+    LOG("ema %u: ", k); print_sample(&level_avg);
+  }
 
-  int which_window = *CHAN_IN2(int, which_window, CH(task_init,task_update_window),
-                                                  SELF_IN_CH(task_update_window));
+#if VERBOSE > 0
+  CASCADE_NEXT(task_output);
+#else // VERBOSE
+  CASCADE_NEXT(task_pack);
+#endif // VERBOSE
+}
+
+#else // !ENABLE_EMA_CASCADE
+
+/* Updates level which_window of the cascade with its new average: sends it
+   out, saves it in the level's window of averages, and points window[] at
+   that window, i.e. at what the next level averages. Returns the next level
+   (0 after the last one). */
+static int update_level(int which_window, const win_avg_t *res, const samp_t *window[])
+{
+  const samp_t *avg = &res->avg;
 
   /*Get the index for this window that we need to update*/
   int win_i = *CHAN_IN2(int, win_i[which_window], CH(task_init,task_update_window), 
                                                   SELF_IN_CH(task_update_window));
 
   /* Window average is ready for this window, forward to output, packing, and sending tasks */
-  LOG("SEND {T:%i,"
-         "M:{%i,%i,%i},"
-         "A:{%i,%i,%i},"
-#ifdef ENABLE_GYRO
-         "G:{%i,%i,%i}"
-#endif // ENABLE_GYRO
-         "\r\n",
-      avg.temp,
-      avg.mx, avg.my, avg.mz,
-      avg.ax, avg.ay, avg.az
-#ifdef ENABLE_GYRO
-      ,avg.gx, avg.gy, avg.gz
-#endif // ENABLE_GYRO
-      );
+  LOG("SEND "); print_sample(avg);
 
-  CHAN_OUT1(samp_t, win_avg[which_window], avg,
+  CHAN_OUT1(samp_t, win_avg[which_window], *avg,
+            MC_OUT_CH(out, task_update_window, task_output, task_pack));
+#ifdef ENABLE_WINDOW_STATS
+  CHAN_OUT1(samp_stats_t, win_stats[which_window], res->stats,
             MC_OUT_CH(out, task_update_window, task_output, task_pack));
+#endif // ENABLE_WINDOW_STATS
 
   /*Use window ID and win index to self-chan the average, saving it*/
   //WINGET(which_window,win_i,TEMP)
-  CHAN_OUT1(samp_t, windows[WINGET(which_window,win_i)], avg, SELF_OUT_CH(task_update_window));
+  CHAN_OUT1(samp_t, windows[WINGET(which_window,win_i)], *avg, SELF_OUT_CH(task_update_window));
 
   /*Send self the next win_i for this window*/
   int next_wini = (win_i + 1) % WINDOW_SIZE;
   CHAN_OUT1(int, win_i[which_window], next_wini, SELF_OUT_CH(task_update_window));
 
-  /*Determine the next window to average*/
-  int next_window = (which_window + 1) % NUM_WINDOWS;
-  CHAN_OUT1(int, which_window, next_window, SELF_OUT_CH(task_update_window));
-
-    /*For pretty printing*/ 
-    /*
-    unsigned s; 
-    for( s = 0; s < which_window; s++ ){
-      LOG(" ");
-    }
-    LOG("%i[",which_window);
-    */
-    
     /*Put this average in the next window, 
       then re-average that window*/
     unsigned i;
     for(i = 0; i < WINDOW_SIZE; i++){
 
       if( i == win_i ){
-        /*window[win_i] that goes back to task_update_window_start gets the avg*/
- 
-        //LOG("W");
-        CHAN_OUT1(samp_t, window[i], avg, CH(task_update_window, task_update_window_start));
-        
+        /*window[win_i] gets the avg*/
+        window[i] = avg;
       }else{
-        /*window[i != win_i] that goes back to task_update_window_start gets self's window[i]*/
-
-        //LOG("O");
-        /*In the value from the self channel*/
-        samp_t sample = *CHAN_IN2(samp_t, windows[WINGET(which_window,i)], CH(task_window,task_update_window),
-                                                                           SELF_IN_CH(task_update_window));
-
-        /*Out the value back to task_update_window_start for averaging*/
-        CHAN_OUT1(samp_t, window[i], sample, CH(task_update_window, task_update_window_start));
+        /*window[i != win_i] gets self's window[i] (the self channel write
+          above is to another one, and only takes effect at the transition)*/
+        window[i] = CHAN_IN2(samp_t, windows[WINGET(which_window,i)], CH(task_window,task_update_window),
+                                                                      SELF_IN_CH(task_update_window));
       }
 
     }
-    //LOG("]\r\n");
+
+  /*Determine the next window to average*/
+  return which_window + 1 < NUM_WINDOWS ? which_window + 1 : 0;
+}
+
+/* Each run updates a level of the cascade, or, with ENABLE_JIT_COALESCE,
+   the levels from it on while CASCADE_COALESCE(): the ones after the first
+   are averaged here rather than in a run of task_update_window_start of
+   their own. A level reads no state of the levels below, so the state
+   written for them, which only takes effect at the transition, does not
+   get in the way, and a re-executed run starts over from the first one. */
+void task_update_window(){
+  BENCH_TASK(task_update_window);
+
+  LOG("task update_window\r\n");
+
+  /*Get the average and window ID from the averaging call*/
+  win_avg_t res;
+  res.avg = *CHAN_IN1(samp_t, average, CH(task_update_window_start, task_update_window));
+#ifdef ENABLE_WINDOW_STATS
+  res.stats = *CHAN_IN1(samp_stats_t, stats, CH(task_update_window_start, task_update_window));
+#endif // ENABLE_WINDOW_STATS
+
+  int which_window = *CHAN_IN2(int, which_window, CH(task_init,task_update_window),
+                                                  SELF_IN_CH(task_update_window));
+
+  const samp_t *window[WINDOW_SIZE];
+  int next_window;
+  while ((next_window = update_level(which_window, &res, window)) != 0 && CASCADE_COALESCE()) {
+    LOG("coalesce %i\r\n", next_window);
+    average_window(&res, window);
+    which_window = next_window;
+  }
+
+  CHAN_OUT1(int, which_window, next_window, SELF_OUT_CH(task_update_window));
+#if defined(ENABLE_JIT_COALESCE) && defined(ENABLE_DOUBLE_BUFFER)
+  /* The next step of the cascade, past the levels done here */
+  unsigned stage = 2 * (next_window != 0 ? next_window : NUM_WINDOWS);
+  CHAN_OUT1(unsigned, stage, stage, CH(task_update_window, task_schedule));
+#endif // ENABLE_JIT_COALESCE && ENABLE_DOUBLE_BUFFER
 
   if(next_window != 0){
     /*Not the last window: average the next one*/
-    TRANSITION_TO(task_update_window_start);
+    for (unsigned i = 0; i < WINDOW_SIZE; i++)
+      CHAN_OUT1(samp_t, window[i], *window[i], CH(task_update_window, task_update_window_start));
+    CASCADE_NEXT(task_update_window_start);
   }else{
     /*The last window: output, then go back to sampling*/
 #if VERBOSE > 0
-    TRANSITION_TO(task_output);
+    CASCADE_NEXT(task_output);
 #else // VERBOSE
-    TRANSITION_TO(task_pack);
+    CASCADE_NEXT(task_pack);
 #endif // VERBOSE
   }
 }
 
+#endif // !ENABLE_EMA_CASCADE
+
 void task_output() {
+  BENCH_TASK(task_output);
 #if VERBOSE > 0
   LOG("task output\r\n");
     for( unsigned w = 0; w < NUM_WINDOWS; w++ ){
-      samp_t win_avg = *CHAN_IN1(samp_t, win_avg[w], MC_IN_CH(out, task_update_window, task_output));
-      LOG("OUT %u {T:%03i,"
-          "M:{%05i,%05i,%05i}},"
-          "A:{%05i,%05i,%05i}},"
-#ifdef ENABLE_GYRO
-          "G:{%05i,%05i,%05i}"
-#endif // ENABLE_GYRO
-          "\r\n",
-          w, win_avg.temp,
-          win_avg.mx, win_avg.my, win_avg.mz,
-          win_avg.ax, win_avg.ay, win_avg.az
-#ifdef ENABLE_GYRO
-          ,win_avg.gx, win_avg.gy, win_avg.gz
-#endif // ENABLE_GYRO
-          );
+      const samp_t *win_avg = CHAN_IN1(samp_t, win_avg[w], MC_IN_CH(out, task_update_window, task_output));
+      LOG("OUT %u ", w); print_sample(win_avg);
     }
 #endif // VERBOSE
-    TRANSITION_TO(task_pack);
+    CASCADE_NEXT(task_pack);
 }
 
-static int scale_mag_sample(int v, int neg_edge, int pos_edge, int overflow)
+/* Downsample shift of a field: with ENABLE_AUTORANGE, the values are
+   normalized across ranges, and the shift depends on the ranges of the
+   window, so that the packed field spans the range in use */
+static inline unsigned pack_shift(unsigned f, uint8_t range)
 {
-  int scaled;
-  if (v == -4096) {
-      scaled = overflow;
-  } else {
-    scaled = v / MAG_DOWNSAMPLE_FACTOR;
-    if (scaled < neg_edge) {
-      scaled = neg_edge;
-    } else if (scaled > pos_edge) {
-      scaled = pos_edge;
+  unsigned shift = pkt_field_shift(f);
+#ifdef ENABLE_AUTORANGE
+  unsigned sensor = pkt_field_sensor(f);
+  if (sensor == PKT_SENSOR_ACCEL)
+    shift -= AUTORANGE_ACCEL_NORM_SHIFT;
+  else if (sensor == PKT_SENSOR_GYRO)
+    shift -= AUTORANGE_GYRO_NORM_SHIFT;
+  shift += pkt_range_exp(sensor, range);
+#else // !ENABLE_AUTORANGE
+  (void)range;
+#endif // !ENABLE_AUTORANGE
+  return shift;
+}
+
+/* v / 2^shift, truncated toward zero like the division, but without one */
+static inline int div_pow2(int v, unsigned shift)
+{
+  return v < 0 ? -(int)(-(unsigned)v >> shift) : v >> shift;
+}
+
+/* Scale a sample (an average, min or max) down to the packet field widths,
+   with saturation (all fields are signed) */
+static void scale_sample(pkt_win_t *win, const samp_t *s)
+{
+  for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f) {
+    int max = (1 << (pkt_field_bits(f) - 1)) - 1;
+    int min = -max - 1;
+    int v = s->v[f];
+
+    // The magnetometer returns a value in [-2048, 2047], or -4096 on
+    // overflow: we shrink the valid range by one, and reserve the
+    // minimum for overflow.
+    if (pkt_field_sensor(f) == PKT_SENSOR_MAG) {
+      if (v == MAGNETOMETER_OVERFLOW) {
+        win->v[f] = min;
+        continue;
+      }
+      ++min;
     }
+
+    v = div_pow2(v, pack_shift(f, SAMP_RANGE(s)));
+    win->v[f] = v < min ? min : (v > max ? max : v);
   }
-  return scaled;
 }
 
-static int scale_lsm_sample(int v, int factor, int min, int max)
+#ifdef ENABLE_WINDOW_STATS
+static int scale_lvar(int lvar, int downsample_shift)
 {
-  v /= factor;
-  if (v < min)
-    v = min;
-  if (v > max)
-    v = max;
-  return v;
+  if (lvar == 0)
+    return 0;
+  lvar -= 2 * downsample_shift; // var / factor^2
+  if (lvar < 0)
+    lvar = 0;
+  if (lvar > PKT_STATS_LVAR_MAX)
+    lvar = PKT_STATS_LVAR_MAX;
+  return lvar;
 }
 
-void task_pack() {
+static void scale_sample_lvar(pkt_win_t *win, const samp_t *s)
+{
+  for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+    win->v[f] = scale_lvar(s->v[f], pack_shift(f, SAMP_RANGE(s)));
+}
+#endif // ENABLE_WINDOW_STATS
 
-    LOG("task pack\r\n");
+#ifdef ENABLE_TXQ
+/* A packet is an event when the shortest timescale departs from the
+   longest one, by at least the threshold in some field (packed units) */
+static bool is_event(const pkt_win_t *shortest, const pkt_win_t *longest)
+{
+  for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f) {
+    if (abs(shortest->v[f] - longest->v[f]) >= TXQ_EVENT_THRESHOLD)
+      return true;
+  }
+  return false;
+}
+#endif // ENABLE_TXQ
 
-    pkt_t pkt;
+#ifdef ENABLE_TX_SUPPRESS
+static bool win_changed(const pkt_win_t *win, const pkt_win_t *last)
+{
+  static const uint8_t threshold[] = {
+    [PKT_SENSOR_TEMP]  = TX_SUPPRESS_THRESHOLD_TEMP,
+    [PKT_SENSOR_MAG]   = TX_SUPPRESS_THRESHOLD_MAG,
+    [PKT_SENSOR_ACCEL] = TX_SUPPRESS_THRESHOLD_ACCEL,
+    [PKT_SENSOR_GYRO]  = TX_SUPPRESS_THRESHOLD_GYRO,
+  };
+  for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f) {
+    if (abs(win->v[f] - last->v[f]) > threshold[pkt_field_sensor(f)])
+      return true;
+  }
+  return false;
+}
+
+/* Whether the packet carries news since the last one sent: the windows
+   (and statistics) by the thresholds, and the ranges and the spectral
+   peaks if at all. The magnetometer calibration is a report in rotation,
+   which doesn't count: it rides along with the packets that go. */
+static bool pkt_changed(const pkt_t *pkt, const pkt_t *last)
+{
+  for (unsigned i = 0; i < PKT_NUM_WINDOWS; i++) {
+    pkt_win_t win, last_win;
+    pkt_win_unpack(pkt->windows[i], &win);
+    pkt_win_unpack(last->windows[i], &last_win);
+    if (win_changed(&win, &last_win))
+      return true;
+  }
+#ifdef ENABLE_WINDOW_STATS
+  for (unsigned i = 0; i < PKT_NUM_STATS; i++) {
+    pkt_stats_t stats, last_stats;
+    pkt_stats_unpack(pkt->stats[i], &stats);
+    pkt_stats_unpack(last->stats[i], &last_stats);
+    if (win_changed(&stats.min, &last_stats.min) ||
+        win_changed(&stats.max, &last_stats.max) ||
+        win_changed(&stats.lvar, &last_stats.lvar))
+      return true;
+  }
+#endif // ENABLE_WINDOW_STATS
+#ifdef ENABLE_SPECTRUM
+  if (memcmp(pkt->peaks, last->peaks, sizeof(pkt->peaks)))
+    return true;
+#endif // ENABLE_SPECTRUM
+#ifdef ENABLE_AUTORANGE
+  if (memcmp(pkt->ranges, last->ranges, sizeof(pkt->ranges)))
+    return true;
+#ifdef ENABLE_WINDOW_STATS
+  if (memcmp(pkt->stats_ranges, last->stats_ranges, sizeof(pkt->stats_ranges)))
+    return true;
+#endif // ENABLE_WINDOW_STATS
+#endif // ENABLE_AUTORANGE
+  return false;
+}
+#endif // ENABLE_TX_SUPPRESS
+
+#ifdef ENABLE_LINK_BUDGET
+
+/* The budget for this transmit opportunity, from the last one and from how
+   the link fared with the last frame (see LINK_BUDGET_MAX) */
+static unsigned budget_update(unsigned budget, bool rebooted)
+{
+  unsigned min = PKT_FIXED_SIZE + pkt_win_size_groups(PKT_GROUPS_LOW) + PKT_WIN_RANGE_SIZE;
+#ifdef ENABLE_UART_DMA
+  unsigned pending = uartdma_pending();
+#else // !ENABLE_UART_DMA
+  unsigned pending = 0;
+#endif // !ENABLE_UART_DMA
+
+  if (rebooted)
+    budget >>= 1;
+  else if (pending)
+    budget = budget > pending ? budget - pending : 0;
+  else
+    budget += LINK_BUDGET_STEP;
+
+  if (budget < min)
+    budget = min;
+  if (budget > PKT_BUDGET_MAX)
+    budget = PKT_BUDGET_MAX;
+  return budget;
+}
+
+/* The levels that fit the budget with the fields of the given groups: the
+   ones in PKT_WINDOW_LEVELS first, in that order, then the others from the
+   lowest up, and at least one; *count is how many */
+static unsigned pkt_fit(unsigned budget, unsigned groups, unsigned *count)
+{
+  unsigned win_size = pkt_win_size_groups(groups) + PKT_WIN_RANGE_SIZE;
+  unsigned size = PKT_FIXED_SIZE;
+  unsigned levels = 0, n = 0;
+  for (unsigned i = 0; i < PKT_NUM_LEVELS + NUM_WINDOWS; ++i) {
+    unsigned w = i < PKT_NUM_LEVELS ? pkt_window_indexes[i] : i - PKT_NUM_LEVELS;
+    if (levels & (1u << w))
+      continue;
+    if (n > 0 && size + win_size > budget)
+      break;
+    levels |= 1u << w;
+    size += win_size;
+    ++n;
+  }
+  *count = n;
+  return levels;
+}
 
-    // zero-out
-    for (unsigned i = 0; i < sizeof(pkt_t); ++i) {
-        *(((uint8_t *)&pkt) + i) = 0x0;
+/* The composition of the packet for the budget, into its header: all the
+   fields if the levels in PKT_WINDOW_LEVELS fit with them, else the fields
+   of PKT_GROUPS_LOW */
+static void pkt_choose(unsigned budget, uint8_t *hdr)
+{
+  unsigned n;
+  unsigned groups = PKT_GROUPS_ALL;
+  unsigned levels = pkt_fit(budget, groups, &n);
+  if (n < PKT_NUM_LEVELS) {
+    groups = PKT_GROUPS_LOW;
+    levels = pkt_fit(budget, groups, &n);
+  }
+  hdr[PKT_HDR_LEVELS] = levels;
+  hdr[PKT_HDR_GROUPS] = groups;
+}
+
+/* The packet as it goes on the wire (see pkt.h): the header, the windows
+   of its levels with the fields of its groups, then the rest; returns the
+   length */
+static unsigned pkt_compose(uint8_t *buf, const pkt_t *pkt)
+{
+  unsigned levels = pkt->hdr[PKT_HDR_LEVELS];
+  unsigned groups = pkt->hdr[PKT_HDR_GROUPS];
+  uint8_t *p = buf;
+
+  memcpy(p, pkt->hdr, PKT_HDR_SIZE);
+  p += PKT_HDR_SIZE;
+  for (unsigned w = 0; w < PKT_NUM_WINDOWS; ++w) {
+    if (levels & (1u << w)) {
+      pkt_win_t win;
+      pkt_win_unpack(pkt->windows[w], &win);
+      p += pkt_win_pack_groups(p, &win, groups);
     }
+  }
+#ifdef ENABLE_WINDOW_STATS
+  memcpy(p, pkt->stats, sizeof(pkt->stats));
+  p += sizeof(pkt->stats);
+#endif // ENABLE_WINDOW_STATS
+#ifdef ENABLE_MAG_CAL
+  memcpy(p, pkt->cal, sizeof(pkt->cal));
+  p += sizeof(pkt->cal);
+#endif // ENABLE_MAG_CAL
+#ifdef ENABLE_SPECTRUM
+  memcpy(p, pkt->peaks, sizeof(pkt->peaks));
+  p += sizeof(pkt->peaks);
+#endif // ENABLE_SPECTRUM
+#ifdef ENABLE_AUTORANGE
+  for (unsigned w = 0; w < PKT_NUM_WINDOWS; ++w) {
+    if (levels & (1u << w))
+      *p++ = pkt->ranges[w][0];
+  }
+#ifdef ENABLE_WINDOW_STATS
+  memcpy(p, pkt->stats_ranges, sizeof(pkt->stats_ranges));
+  p += sizeof(pkt->stats_ranges);
+#endif // ENABLE_WINDOW_STATS
+#endif // ENABLE_AUTORANGE
+  return p - buf;
+}
+
+#endif // ENABLE_LINK_BUDGET
+
+void task_pack() {
+    BENCH_TASK(task_pack);
+
+    LOG("task pack\r\n");
+
+    pkt_t *pkt = &pkt_tx;
+    pkt_win_t win;
+#ifdef ENABLE_TXQ
+    pkt_win_t win_first;
+#endif // ENABLE_TXQ
+
+#ifdef ENABLE_LINK_BUDGET
+    bool rebooted = !pack_powered;
+    pack_powered = true;
+    unsigned budget = *CHAN_IN2(unsigned, budget, CH(task_init, task_pack),
+                                                  SELF_IN_CH(task_pack));
+    budget = budget_update(budget, rebooted);
+    pkt_choose(budget, pkt->hdr);
+    unsigned levels = pkt->hdr[PKT_HDR_LEVELS];
+    unsigned groups = pkt->hdr[PKT_HDR_GROUPS];
+    LOG("budget %u%s: levels %02x groups %x\r\n", budget, rebooted ? " (reboot)" : "",
+        levels, groups);
+    CHAN_OUT1(unsigned, budget, budget, SELF_OUT_CH(task_pack));
+#endif // ENABLE_LINK_BUDGET
 
     for( unsigned i = 0; i < PKT_NUM_WINDOWS; i++ ){
+#ifdef ENABLE_LINK_BUDGET
+      unsigned w = i;
+#else // !ENABLE_LINK_BUDGET
       unsigned w = pkt_window_indexes[i];
+#endif // !ENABLE_LINK_BUDGET
+
+      const samp_t *win_avg = CHAN_IN1(samp_t, win_avg[w], MC_IN_CH(out, task_update_window, task_output));
+
+      LOG("packing: win %u ", w); print_sample(win_avg);
+
+      scale_sample(&win, win_avg);
+
+#ifdef ENABLE_LINK_BUDGET
+      // The slot holds what goes on the wire, and zeros for what does not
+      // (so that ENABLE_TX_SUPPRESS compares what is sent)
+      bool carried = levels & (1u << w);
+      pkt_win_t packed;
+      for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+        packed.v[f] = carried && (groups & (1u << pkt_field_sensor(f))) ? win.v[f] : 0;
+      pkt_win_pack(pkt->windows[i], &packed);
+#ifdef ENABLE_AUTORANGE
+      pkt->ranges[i][0] = carried ? win_avg->range : 0;
+#endif // ENABLE_AUTORANGE
+#else // !ENABLE_LINK_BUDGET
+      pkt_win_pack(pkt->windows[i], &win);
+#ifdef ENABLE_AUTORANGE
+      pkt->ranges[i][0] = win_avg->range;
+#endif // ENABLE_AUTORANGE
+#endif // !ENABLE_LINK_BUDGET
+#ifdef ENABLE_TXQ
+      if (i == 0)
+        win_first = win;
+#endif // ENABLE_TXQ
+
+      LOG("scaled: "); print_win(&win);
+
+        // Read back what went on the wire
+        pkt_win_t unpacked;
+        pkt_win_unpack(pkt->windows[i], &unpacked);
+        pkt_win_unscale(&unpacked, &unpacked);
+#ifdef ENABLE_AUTORANGE
+        pkt_win_unscale_range(&unpacked, pkt->ranges[i][0]);
+#endif // ENABLE_AUTORANGE
+
+        LOG("unpacked: "); print_win(&unpacked);
+    }
 
-      samp_t win_avg = *CHAN_IN1(samp_t, win_avg[w], MC_IN_CH(out, task_update_window, task_output));
+#ifdef ENABLE_WINDOW_STATS
+    for (unsigned i = 0; i < PKT_NUM_STATS; i++) {
+      unsigned w = pkt_stats_indexes[i];
 
-      LOG("packing: win %u {T:%03i,"
-          "M:{%05i,%05i,%05i}}"
-          "A:{%05i,%05i,%05i},"
-#ifdef ENABLE_GYRO
-          "G:{%05i,%05i,%05i}"
-#endif // ENABLE_GYRO
-          "\r\n",
-          w, win_avg.temp,
-          win_avg.mx, win_avg.my, win_avg.mz,
-          win_avg.ax, win_avg.ay, win_avg.az
-#ifdef ENABLE_GYRO
-          ,win_avg.gx, win_avg.gy, win_avg.gz
-#endif // ENABLE_GYRO
-          );
-
-      pkt.windows[i].temp = win_avg.temp; // use full byte
-
-      // Normally, sensor returns a value in [-2048, 2047].
-      // On either overflow, sensor return -4096.
-      //
-      // We shrink the valid range to [-2047,2047] and
-      // reserve -2048 for overflow.
-      //
-      // Then, we also truncate.
-      int abs_edge = 1 << (PKT_FIELD_MAG_BITS - 1); // -1, ie. div by 2, because signed
-      int neg_edge = -(abs_edge - 1); // reserve for overflow
-      int pos_edge = abs_edge - 1;
-      int overflow = -abs_edge;
-      LOG("scaling: abs %i [%i, %i] ovflw %i\r\n", abs_edge, neg_edge, pos_edge, overflow);
-
-      pkt.windows[i].mx = scale_mag_sample(win_avg.mx, neg_edge, pos_edge, overflow);
-      pkt.windows[i].my = scale_mag_sample(win_avg.my, neg_edge, pos_edge, overflow);
-      pkt.windows[i].mz = scale_mag_sample(win_avg.mz, neg_edge, pos_edge, overflow);
-
-      // Accel and gyro are simple (since there's no special overflow value)
-      pkt.windows[i].ax = scale_lsm_sample(win_avg.ax, ACCEL_DOWNSAMPLE_FACTOR, ACCEL_MIN, ACCEL_MAX);
-      pkt.windows[i].ay = scale_lsm_sample(win_avg.ay, ACCEL_DOWNSAMPLE_FACTOR, ACCEL_MIN, ACCEL_MAX);
-      pkt.windows[i].az = scale_lsm_sample(win_avg.az, ACCEL_DOWNSAMPLE_FACTOR, ACCEL_MIN, ACCEL_MAX);
-#ifdef ENABLE_GYRO
-      pkt.windows[i].gx = scale_lsm_sample(win_avg.gx, GYRO_DOWNSAMPLE_FACTOR, GYRO_MIN, GYRO_MAX);
-      pkt.windows[i].gy = scale_lsm_sample(win_avg.gy, GYRO_DOWNSAMPLE_FACTOR, GYRO_MIN, GYRO_MAX);
-      pkt.windows[i].gz = scale_lsm_sample(win_avg.gz, GYRO_DOWNSAMPLE_FACTOR, GYRO_MIN, GYRO_MAX);
-#endif // ENABLE_GYRO
+      const samp_stats_t *win_stats = CHAN_IN1(samp_stats_t, win_stats[w],
+                                               MC_IN_CH(out, task_update_window, task_output));
+      pkt_stats_t stats;
+      scale_sample(&stats.min, &win_stats->min);
+      scale_sample(&stats.max, &win_stats->max);
+      scale_sample_lvar(&stats.lvar, &win_stats->lvar);
 
-      LOG("scaled (/ %u): t %i | mx %i my %i mz %i | ax %i ay %i az %i "
-#ifdef ENABLE_GYRO
-          "| gx %i gy %i gz %i"
-#endif // ENABLE_GYRO
-          "\r\n",
-           MAG_DOWNSAMPLE_FACTOR,
-           pkt.windows[i].temp,
-           pkt.windows[i].mx, pkt.windows[i].my, pkt.windows[i].mz,
-           pkt.windows[i].ax, pkt.windows[i].ay, pkt.windows[i].az
-#ifdef ENABLE_GYRO
-           ,pkt.windows[i].gx, pkt.windows[i].gy, pkt.windows[i].gz
-#endif // ENABLE_GYRO
-           );
+      LOG("packing stats: win %u lvar: ", w); print_win(&stats.lvar);
 
-        LOG("unpacked: t %i | mx %i my %i mz %i | ax %i ay %i az %i "
-#ifdef ENABLE_GYRO
-            "| gx %i gy %i gz %i"
-#endif // ENABLE_GYRO
-            "\r\n",
-            (int)pkt.windows[i].temp,
-            (int)pkt.windows[i].mx * MAG_DOWNSAMPLE_FACTOR,
-            (int)pkt.windows[i].my * MAG_DOWNSAMPLE_FACTOR,
-            (int)pkt.windows[i].mz * MAG_DOWNSAMPLE_FACTOR,
-            (int)pkt.windows[i].ax * ACCEL_DOWNSAMPLE_FACTOR,
-            (int)pkt.windows[i].ay * ACCEL_DOWNSAMPLE_FACTOR,
-            (int)pkt.windows[i].az * ACCEL_DOWNSAMPLE_FACTOR
-#ifdef ENABLE_GYRO
-            ,(int)pkt.windows[i].gx * GYRO_DOWNSAMPLE_FACTOR
-            ,(int)pkt.windows[i].gy * GYRO_DOWNSAMPLE_FACTOR
-            ,(int)pkt.windows[i].gz * GYRO_DOWNSAMPLE_FACTOR
-#endif // ENABLE_GYRO
-            );
+      pkt_stats_pack(pkt->stats[i], &stats);
+#ifdef ENABLE_AUTORANGE
+      pkt->stats_ranges[i][0] = win_stats->min.range;
+#endif // ENABLE_AUTORANGE
     }
+#endif // ENABLE_WINDOW_STATS
+
+#ifdef ENABLE_MAG_CAL
+    // One axis per packet, in rotation
+    const magcal_cal_t *mag_cal = CHAN_IN1(magcal_cal_t, cal, CH(task_sample, task_pack));
+    unsigned cal_axis = *CHAN_IN2(unsigned, cal_axis, CH(task_init, task_pack),
+                                                      SELF_IN_CH(task_pack));
+    pkt_cal_t cal;
+    magcal_report(mag_cal, cal_axis, &cal);
+    if (mag_cal->valid) {
+      cal_axis = (cal_axis + 1) % MAGCAL_AXES;
+      CHAN_OUT1(unsigned, cal_axis, cal_axis, SELF_OUT_CH(task_pack));
+    }
+    LOG("mag cal: axis %i offset %i scale %i\r\n", cal.axis, cal.offset, cal.scale);
+    pkt_cal_pack(pkt->cal, &cal);
+#endif // ENABLE_MAG_CAL
+
+#ifdef ENABLE_SPECTRUM
+    const pkt_peaks_t *peaks = CHAN_IN2(pkt_peaks_t, peaks, CH(task_init, task_pack),
+                                        CH(task_spectrum_peaks, task_pack));
+    pkt_peaks_pack(pkt->peaks, peaks);
+#endif // ENABLE_SPECTRUM
+
+#ifdef ENABLE_TXQ
+    // win holds the last packed window, i.e. the longest timescale
+    bool event = is_event(&win_first, &win);
+    LOG("event: %u\r\n", event);
+#endif // ENABLE_TXQ
+
+#ifdef ENABLE_TX_SUPPRESS
+    unsigned unsent = *CHAN_IN2(unsigned, unsent, CH(task_init, task_pack),
+                                                  SELF_IN_CH(task_pack));
+    bool send = unsent >= TX_KEYFRAME_INTERVAL - 1 ||
+                pkt_changed(pkt, CHAN_IN1(pkt_t, last, SELF_IN_CH(task_pack)));
+#ifdef ENABLE_TXQ
+    send = send || event;
+#endif // ENABLE_TXQ
+    LOG("send: %u (unsent %u)\r\n", send, unsent);
+    if (send) {
+      CHAN_OUT1(pkt_t, last, *pkt, SELF_OUT_CH(task_pack));
+      unsent = 0;
+    } else {
+      ++unsent;
+    }
+    CHAN_OUT1(unsigned, unsent, unsent, SELF_OUT_CH(task_pack));
+    CHAN_OUT1(bool, send, send, CH(task_pack, task_send));
+#endif // ENABLE_TX_SUPPRESS
+
+#ifdef ENABLE_TXQ
+    CHAN_OUT1(bool, event, event, CH(task_pack, task_send));
+#endif // ENABLE_TXQ
+    CASCADE_NEXT(task_send);
+}
 
-    CHAN_OUT1(pkt_t, pkt, pkt, CH(task_pack, task_send));
-    TRANSITION_TO(task_send);
+static void send_payload(const uint8_t *payload, unsigned len)
+{
+    LOG("pkt (len %u)\r\n", len);
+    LOG2("pkt bytes: ");
+    for (unsigned i = 0; i < len; ++i) {
+        LOG2("%02x ", payload[i]);
+    }
+    LOG2("\r\n");
+
+#ifdef ENABLE_UART_DMA
+    // The frame is drained by DMA after the task returns, so it goes into a
+    // buffer of its own, in FRAM, which is reused only once the previous
+    // frame is out (uartdma_send waits for that).
+    static __nv uint8_t frame[LINK_FRAME_SIZE(MAX_PAYLOAD_SIZE)];
+    uartdma_wait();
+#ifdef LINK_FRAMING
+    unsigned frame_len = link_frame(frame, payload, len);
+#else // !LINK_FRAMING
+    unsigned frame_len = len;
+    memcpy(frame, payload, len);
+#endif // !LINK_FRAMING
+    uartdma_send(frame, frame_len);
+#else // !ENABLE_UART_DMA
+    uartlink_open_tx();
+#ifdef LINK_FRAMING
+    static uint8_t frame[LINK_FRAME_SIZE(MAX_PAYLOAD_SIZE)];
+    unsigned frame_len = link_frame(frame, payload, len);
+    uartlink_send(frame, frame_len);
+#else // !LINK_FRAMING
+    uartlink_send((uint8_t *)payload, len);
+#endif // !LINK_FRAMING
+    uartlink_close();
+#endif // !ENABLE_UART_DMA
 }
 
+#ifdef ENABLE_TXQ
+
+/* Queue the new packet, then, if this cycle is a transmit opportunity,
+   send the most valuable queued packets */
 void task_send() {
+  BENCH_TASK(task_send);
   LOG("task send\r\n");
 
     WATCHPOINT(WATCHPOINT_OUTPUT);
 
-    pkt_t pkt = *CHAN_IN1(pkt_t, pkt, CH(task_pack, task_send));
+    txq_meta_t meta[TXQ_SIZE];
+    unsigned dirty = 0; // bitmask of modified meta entries
 
-    LOG("pkt (len %u): ", sizeof(pkt_t));
-    for (unsigned i = 0; i < sizeof(pkt_t); ++i) {
-        LOG("%02x ", *(((uint8_t *)&pkt) + i));
+    for (unsigned i = 0; i < TXQ_SIZE; ++i) {
+        meta[i] = *CHAN_IN2(txq_meta_t, meta[i], CH(task_init, task_send),
+                                                 SELF_IN_CH(task_send));
+    }
+    uint16_t seq = *CHAN_IN2(uint16_t, seq, CH(task_init, task_send), SELF_IN_CH(task_send));
+    unsigned cycle = *CHAN_IN2(unsigned, cycle, CH(task_init, task_send), SELF_IN_CH(task_send));
+
+    const pkt_t *pkt = &pkt_tx;
+    bool event = *CHAN_IN1(bool, event, CH(task_pack, task_send));
+
+    txq_meta_t incoming = { seq, TXQ_VALID | (event ? TXQ_EVENT : 0) };
+#ifdef ENABLE_TX_SUPPRESS
+    // An unchanged packet is not queued, but it still takes its sequence
+    // number, so that the ground sees the gap
+    bool queue = *CHAN_IN1(bool, send, CH(task_pack, task_send));
+#else // !ENABLE_TX_SUPPRESS
+    bool queue = true;
+#endif // !ENABLE_TX_SUPPRESS
+    int slot = queue ? txq_slot(meta, TXQ_SIZE, &incoming) : -1;
+    if (slot >= 0) {
+        LOG("txq: seq %u -> slot %i (was seq %u flags %x)\r\n",
+            seq, slot, meta[slot].seq, meta[slot].flags);
+        CHAN_OUT1(pkt_t, pkts[slot], *pkt, SELF_OUT_CH(task_send));
+        meta[slot] = incoming;
+        dirty |= 1 << slot;
+    } else if (queue) {
+        LOG("txq: seq %u dropped\r\n", seq);
+    } else {
+        LOG("txq: seq %u unchanged\r\n", seq);
     }
-    LOG("\r\n");
+    ++seq;
+
+#ifdef ENABLE_ARCHIVE
+    bool spare = false;
+#endif // ENABLE_ARCHIVE
+    if (cycle % TXQ_TX_INTERVAL == 0) {
+        for (unsigned b = 0; b < TXQ_TX_BURST; ++b) {
+            int i = txq_next(meta, TXQ_SIZE);
+            if (i < 0) {
+#ifdef ENABLE_ARCHIVE
+                spare = true; // the queue ran out before the burst did
+#endif // ENABLE_ARCHIVE
+                break;
+            }
+
+            // The self channel still returns the old packet in a slot that
+            // was written in this task
+            txq_pkt_t tx_pkt;
+            tx_pkt.pkt = (i == slot) ? *pkt : *CHAN_IN1(pkt_t, pkts[i], SELF_IN_CH(task_send));
+            uint16_t tx_seq = (meta[i].seq & TXQ_SEQ_MASK) |
+                              ((meta[i].flags & TXQ_EVENT) ? ~TXQ_SEQ_MASK : 0);
+            tx_pkt.seq[0] = tx_seq & 0xff;
+            tx_pkt.seq[1] = tx_seq >> 8;
+
+            LOG("txq: send seq %u from slot %i\r\n", meta[i].seq, i);
+#ifdef ENABLE_LINK_BUDGET
+            uint8_t payload[sizeof(txq_pkt_t)];
+            memcpy(payload, tx_pkt.seq, sizeof(tx_pkt.seq));
+            unsigned len = sizeof(tx_pkt.seq) +
+                           pkt_compose(payload + sizeof(tx_pkt.seq), &tx_pkt.pkt);
+            send_payload(payload, len);
+#else // !ENABLE_LINK_BUDGET
+            send_payload((uint8_t *)&tx_pkt, sizeof(txq_pkt_t));
+#endif // !ENABLE_LINK_BUDGET
+
+            meta[i].flags &= ~TXQ_VALID;
+            dirty |= 1 << i;
+        }
+    }
+    ++cycle;
 
-    uartlink_open_tx();
-    uartlink_send((uint8_t *)&pkt, sizeof(pkt_t));
-    uartlink_close();
+    for (unsigned i = 0; i < TXQ_SIZE; ++i) {
+        if (dirty & (1 << i))
+            CHAN_OUT1(txq_meta_t, meta[i], meta[i], SELF_OUT_CH(task_send));
+    }
+    CHAN_OUT1(uint16_t, seq, seq, SELF_OUT_CH(task_send));
+    CHAN_OUT1(unsigned, cycle, cycle, SELF_OUT_CH(task_send));
+
+    BENCH_PACKET();
 
+#ifdef ENABLE_ARCHIVE
+    CHAN_OUT1(bool, spare, spare, CH(task_send, task_archive));
+    CASCADE_NEXT(task_archive);
+#else // !ENABLE_ARCHIVE
     /* Loop back to the beginning */
-    TRANSITION_TO(task_sample);
+    CASCADE_NEXT(task_sample);
+#endif // !ENABLE_ARCHIVE
+}
+
+#else // !ENABLE_TXQ
+
+void task_send() {
+  BENCH_TASK(task_send);
+  LOG("task send\r\n");
+
+    WATCHPOINT(WATCHPOINT_OUTPUT);
+
+#ifdef ENABLE_TX_SUPPRESS
+    bool send = *CHAN_IN1(bool, send, CH(task_pack, task_send));
+#else // !ENABLE_TX_SUPPRESS
+    bool send = true;
+#endif // !ENABLE_TX_SUPPRESS
+
+    if (send) {
+#ifdef ENABLE_LINK_BUDGET
+        uint8_t payload[sizeof(pkt_t)];
+        send_payload(payload, pkt_compose(payload, &pkt_tx));
+#else // !ENABLE_LINK_BUDGET
+        send_payload((const uint8_t *)&pkt_tx, sizeof(pkt_t));
+#endif // !ENABLE_LINK_BUDGET
+    } else {
+        LOG("unchanged: not sent\r\n");
+    }
+
+    BENCH_PACKET();
+
+#ifdef ENABLE_ARCHIVE
+    bool spare = !send;
+    CHAN_OUT1(bool, spare, spare, CH(task_send, task_archive));
+    CASCADE_NEXT(task_archive);
+#else // !ENABLE_ARCHIVE
+    /* Loop back to the beginning */
+    CASCADE_NEXT(task_sample);
+#endif // !ENABLE_ARCHIVE
+}
+
+#endif // !ENABLE_TXQ
+
+#ifdef ENABLE_ARCHIVE
+
+/* Archive every level of the cascade, then, if task_send left the link
+   unused, downlink the next archived block */
+void task_archive() {
+  BENCH_TASK(task_archive);
+  LOG("task archive\r\n");
+
+    archive_t archive = *CHAN_IN2(archive_t, archive, CH(task_init, task_archive),
+                                                      SELF_IN_CH(task_archive));
+    archive_rec_t last = *CHAN_IN2(archive_rec_t, last, CH(task_init, task_archive),
+                                                        SELF_IN_CH(task_archive));
+    uint16_t next = *CHAN_IN2(uint16_t, next, CH(task_init, task_archive),
+                                              SELF_IN_CH(task_archive));
+
+    archive_rec_t rec;
+    unsigned n = 0;
+    for (unsigned w = 0; w < NUM_WINDOWS; ++w) {
+      const samp_t *win_avg = CHAN_IN1(samp_t, win_avg[w],
+                                       MC_IN_CH(out, task_update_window, task_archive));
+      pkt_win_t win;
+      scale_sample(&win, win_avg);
+      for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+        rec.v[n++] = win.v[f];
+#ifdef ENABLE_AUTORANGE
+      rec.v[n++] = win_avg->range;
+#endif // ENABLE_AUTORANGE
+    }
+    archive_append(&archive, last.v, rec.v, ARCHIVE_VALUES);
+    LOG("archive: seq %u block %u used %u\r\n", archive.seq, archive.block, archive.used);
+
+    bool spare = *CHAN_IN1(bool, spare, CH(task_send, task_archive));
+    if (archive_next(&archive, &next) && spare) {
+      LOG("archive: send block %u\r\n", next);
+      send_payload(archive_block(next), ARCHIVE_BLOCK_SIZE);
+      ++next;
+    }
+
+    CHAN_OUT1(archive_t, archive, archive, SELF_OUT_CH(task_archive));
+    CHAN_OUT1(archive_rec_t, last, last, SELF_OUT_CH(task_archive));
+    CHAN_OUT1(uint16_t, next, next, SELF_OUT_CH(task_archive));
+
+    /* Loop back to the beginning */
+    CASCADE_NEXT(task_sample);
 }
 
+#endif // ENABLE_ARCHIVE
+
+#ifdef ENABLE_BENCH
+
+#define BENCH_KERNEL_REPS 8
+
+/* For results that are not stored anywhere else */
+static volatile unsigned bench_sink;
+
+/* Time the kernels of the pipeline on synthetic input, outside of the
+   tasks, so that the counts exclude channel accesses. The results go to
+   statics, so that the compiler can neither drop the work nor hoist it
+   out of the timed region. */
+static void bench_kernels(void)
+{
+  static samp_t window[WINDOW_SIZE];
+  static stat_t st;
+  static pkt_win_t win;
+  static uint8_t buf[PKT_WIN_SIZE];
+#ifdef ENABLE_WINDOW_STATS
+  static pkt_stats_t stats;
+  static uint8_t stats_buf[PKT_STATS_SIZE];
+#endif // ENABLE_WINDOW_STATS
+#ifdef LINK_FRAMING
+  static uint8_t payload[sizeof(pkt_t)];
+  static uint8_t frame[LINK_FRAME_SIZE(sizeof(pkt_t))];
+#endif // LINK_FRAMING
+#ifdef ENABLE_SPECTRUM
+  static spectrum_bin_t bin;
+#endif // ENABLE_SPECTRUM
+
+  for (unsigned j = 0; j < WINDOW_SIZE; ++j) {
+    for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+      window[j].v[f] = (int)(f * 1000 + j * 37) - 4000;
+#ifdef ENABLE_AUTORANGE
+    window[j].range = 0;
+#endif // ENABLE_AUTORANGE
+  }
+
+  for (unsigned r = 0; r < BENCH_KERNEL_REPS; ++r) {
+    BENCH_BEGIN(empty);
+    BENCH_END(empty);
+
+    unsigned f = r % PKT_NUM_FIELDS;
+    BENCH_BEGIN(stat_window);
+    for (unsigned j = 0; j < WINDOW_SIZE; ++j)
+      stat_add(&st, window[j].v[f], STAT_SHIFT(pkt_field_sbits(f)), j == 0);
+    BENCH_END(stat_window);
+
+    BENCH_BEGIN(scale_sample);
+    scale_sample(&win, &window[r % WINDOW_SIZE]);
+    BENCH_END(scale_sample);
+
+    BENCH_BEGIN(win_pack);
+    pkt_win_pack(buf, &win);
+    BENCH_END(win_pack);
+
+    BENCH_BEGIN(win_unpack);
+    pkt_win_unpack(buf, &win);
+    BENCH_END(win_unpack);
+
+#ifdef ENABLE_WINDOW_STATS
+    stats.min = win;
+    stats.max = win;
+    for (unsigned g = 0; g < PKT_NUM_FIELDS; ++g)
+      stats.lvar.v[g] = (g + r) & PKT_STATS_LVAR_MAX;
+    BENCH_BEGIN(stats_pack);
+    pkt_stats_pack(stats_buf, &stats);
+    BENCH_END(stats_pack);
+#endif // ENABLE_WINDOW_STATS
+
+#ifdef LINK_FRAMING
+    for (unsigned i = 0; i < sizeof(payload); ++i)
+      payload[i] = i + r;
+    BENCH_BEGIN(link_frame);
+    bench_sink = link_frame(frame, payload, sizeof(payload));
+    BENCH_END(link_frame);
+#endif // LINK_FRAMING
+
+#ifdef ENABLE_SPECTRUM
+    spectrum_in_t x, pivot;
+    for (unsigned a = 0; a < SPECTRUM_AXES; ++a) {
+      x.v[a] = window[r % WINDOW_SIZE].v[PKT_F_ax + a];
+      pivot.v[a] = window[0].v[PKT_F_ax + a];
+    }
+    unsigned k = r % SPECTRUM_BINS + 1;
+    BENCH_BEGIN(spectrum_step);
+    spectrum_step(&bin, k, &x, &pivot, r == 0);
+    BENCH_END(spectrum_step);
+
+    BENCH_BEGIN(spectrum_power);
+    bench_sink = spectrum_power(&bin, k);
+    BENCH_END(spectrum_power);
+#endif // ENABLE_SPECTRUM
+  }
+}
+
+#endif // ENABLE_BENCH
+
 INIT_FUNC(initializeHardware)
 ENTRY_TASK(task_init)
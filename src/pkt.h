@@ -0,0 +1,505 @@
+#ifndef PKT_H
+#define PKT_H
+
+// Radio packet layout, shared between the firmware and host-side tools.
+//
+// The layout of a packed window is described by a field schema (below)
+// instead of by compiler bitfields, so that the wire format does not depend
+// on the compiler or ABI. From the schema, the pack/unpack routines are
+// expanded at compile time into straight-line code with constant widths.
+//
+// Wire format: fields are packed LSB-first, in schema order, into a
+// little-endian byte stream; each window starts on a byte boundary. (This
+// happens to match the layout that GCC produced for the packed bitfield
+// struct on MSP430, so decoders for older captures remain valid.)
+//
+// This header must not depend on anything MSP430-specific.
+
+#include <stdint.h>
+
+#define PKT_FIELD_TEMP_BITS 8
+
+/* downsample to signed 4-bit int: 4-bit of downsampled data (i.e [-2^3,+2^3])*/
+#define PKT_FIELD_MAG_BITS 4
+#define SENSOR_BITS_MAG    12
+#define NOT_FULL_SCALE_FACTOR_MAG 2 /* n, where scaling factor is decreased by 2^n because
+                                       the actual dynamic range of the quantity is smaller than full scale */
+#define MAG_DOWNSAMPLE_SHIFT (SENSOR_BITS_MAG - PKT_FIELD_MAG_BITS - NOT_FULL_SCALE_FACTOR_MAG)
+#define MAG_DOWNSAMPLE_FACTOR (1 << MAG_DOWNSAMPLE_SHIFT)
+
+
+#define PKT_FIELD_ACCEL_BITS 4
+#define SENSOR_BITS_ACCEL    16
+#define NOT_FULL_SCALE_FACTOR_ACCEL 0 /* n, where scaling factor is decreased by 2^n because
+                                       the actual dynamic range of the quantity is smaller than full scale */
+#define ACCEL_DOWNSAMPLE_SHIFT (SENSOR_BITS_ACCEL - PKT_FIELD_ACCEL_BITS - NOT_FULL_SCALE_FACTOR_ACCEL)
+#define ACCEL_DOWNSAMPLE_FACTOR (1 << ACCEL_DOWNSAMPLE_SHIFT)
+
+#define ACCEL_MIN  (-(1 << (PKT_FIELD_ACCEL_BITS - 1))) // -1 because signed
+#define ACCEL_MAX  ((1 << (PKT_FIELD_ACCEL_BITS - 1)) - 1) // -1 because signed, -1 because max value
+
+
+#define PKT_FIELD_GYRO_BITS 4
+#define SENSOR_BITS_GYRO    16
+#define NOT_FULL_SCALE_FACTOR_GYRO 1 /* n, where scaling factor is decreased by 2^n because
+                                       the actual dynamic range of the quantity is smaller than full scale */
+#define GYRO_DOWNSAMPLE_SHIFT (SENSOR_BITS_GYRO - PKT_FIELD_GYRO_BITS - NOT_FULL_SCALE_FACTOR_GYRO)
+#define GYRO_DOWNSAMPLE_FACTOR (1 << GYRO_DOWNSAMPLE_SHIFT)
+
+#define GYRO_MIN  (-(1 << (PKT_FIELD_GYRO_BITS - 1))) // -1 because signed
+#define GYRO_MAX  ((1 << (PKT_FIELD_GYRO_BITS - 1)) - 1) // -1 because signed, -1 because max value
+
+#define PKT_SIGNED   1
+#define PKT_UNSIGNED 0
+
+// Sensors: the range code (ENABLE_AUTORANGE) and the overflow value apply
+// per sensor
+#define PKT_SENSOR_TEMP  0
+#define PKT_SENSOR_MAG   1
+#define PKT_SENSOR_ACCEL 2
+#define PKT_SENSOR_GYRO  3
+
+// Width of the sample values of each sensor, before packing
+#define PKT_RANGE_MAG_EXP_MAX 3 /* gain 7 is 4.74x gain 1, see pkt_range_mag_exp() */
+#define SAMP_BITS_TEMP  PKT_FIELD_TEMP_BITS
+#ifdef ENABLE_AUTORANGE
+#define SAMP_BITS_MAG   (SENSOR_BITS_MAG + PKT_RANGE_MAG_EXP_MAX) /* normalized across gains */
+#else // !ENABLE_AUTORANGE
+#define SAMP_BITS_MAG   SENSOR_BITS_MAG
+#endif // !ENABLE_AUTORANGE
+#define SAMP_BITS_ACCEL SENSOR_BITS_ACCEL
+#define SAMP_BITS_GYRO  SENSOR_BITS_GYRO
+
+/* Field descriptor table: one line per field of a sample (in the firmware)
+ * and of a packed window (on the wire, in this order):
+ *    F(name, sensor, sample bits, packed bits [1..16], signedness, downsample shift)
+ * A packed field is the sample value divided by 2^shift (by more, for a
+ * sensor at a higher range), saturated to the packed width. */
+#define PKT_FIELDS_BASE(F) \
+    F(temp, TEMP,  SAMP_BITS_TEMP,  PKT_FIELD_TEMP_BITS,  PKT_SIGNED, 0) \
+    F(mx,   MAG,   SAMP_BITS_MAG,   PKT_FIELD_MAG_BITS,   PKT_SIGNED, MAG_DOWNSAMPLE_SHIFT) \
+    F(my,   MAG,   SAMP_BITS_MAG,   PKT_FIELD_MAG_BITS,   PKT_SIGNED, MAG_DOWNSAMPLE_SHIFT) \
+    F(mz,   MAG,   SAMP_BITS_MAG,   PKT_FIELD_MAG_BITS,   PKT_SIGNED, MAG_DOWNSAMPLE_SHIFT) \
+    F(ax,   ACCEL, SAMP_BITS_ACCEL, PKT_FIELD_ACCEL_BITS, PKT_SIGNED, ACCEL_DOWNSAMPLE_SHIFT) \
+    F(ay,   ACCEL, SAMP_BITS_ACCEL, PKT_FIELD_ACCEL_BITS, PKT_SIGNED, ACCEL_DOWNSAMPLE_SHIFT) \
+    F(az,   ACCEL, SAMP_BITS_ACCEL, PKT_FIELD_ACCEL_BITS, PKT_SIGNED, ACCEL_DOWNSAMPLE_SHIFT) \
+
+#ifdef ENABLE_GYRO
+#define PKT_FIELDS_GYRO(F) \
+    F(gx,   GYRO,  SAMP_BITS_GYRO,  PKT_FIELD_GYRO_BITS,  PKT_SIGNED, GYRO_DOWNSAMPLE_SHIFT) \
+    F(gy,   GYRO,  SAMP_BITS_GYRO,  PKT_FIELD_GYRO_BITS,  PKT_SIGNED, GYRO_DOWNSAMPLE_SHIFT) \
+    F(gz,   GYRO,  SAMP_BITS_GYRO,  PKT_FIELD_GYRO_BITS,  PKT_SIGNED, GYRO_DOWNSAMPLE_SHIFT) \
+
+#else // !ENABLE_GYRO
+#define PKT_FIELDS_GYRO(F)
+#endif // !ENABLE_GYRO
+
+#define PKT_FIELDS(F) PKT_FIELDS_BASE(F) PKT_FIELDS_GYRO(F)
+
+// Index of each field: PKT_F_<name>
+#define PKT_FIELD_INDEX(name, sensor, sbits, bits, sgn, shift) PKT_F_ ## name,
+enum {
+    PKT_FIELDS(PKT_FIELD_INDEX)
+    PKT_NUM_FIELDS
+};
+
+// Unpacked (but already scaled down) values of one window
+typedef struct {
+    int v[PKT_NUM_FIELDS];
+} pkt_win_t;
+
+// Descriptors by index, for loops over the fields
+#define PKT_FIELD_SENSOR_OF(name, sensor, sbits, bits, sgn, shift) PKT_SENSOR_ ## sensor,
+#define PKT_FIELD_SBITS_OF(name, sensor, sbits, bits, sgn, shift) sbits,
+#define PKT_FIELD_BITS_OF(name, sensor, sbits, bits, sgn, shift) bits,
+#define PKT_FIELD_SHIFT_OF(name, sensor, sbits, bits, sgn, shift) shift,
+#define PKT_FIELD_NAME_OF(name, sensor, sbits, bits, sgn, shift) #name,
+
+static inline unsigned pkt_field_sensor(unsigned f)
+{
+    static const uint8_t tab[PKT_NUM_FIELDS] = { PKT_FIELDS(PKT_FIELD_SENSOR_OF) };
+    return tab[f];
+}
+
+static inline unsigned pkt_field_sbits(unsigned f)
+{
+    static const uint8_t tab[PKT_NUM_FIELDS] = { PKT_FIELDS(PKT_FIELD_SBITS_OF) };
+    return tab[f];
+}
+
+static inline unsigned pkt_field_bits(unsigned f)
+{
+    static const uint8_t tab[PKT_NUM_FIELDS] = { PKT_FIELDS(PKT_FIELD_BITS_OF) };
+    return tab[f];
+}
+
+static inline unsigned pkt_field_shift(unsigned f)
+{
+    static const uint8_t tab[PKT_NUM_FIELDS] = { PKT_FIELDS(PKT_FIELD_SHIFT_OF) };
+    return tab[f];
+}
+
+static inline const char *pkt_field_name(unsigned f)
+{
+    static const char *const tab[PKT_NUM_FIELDS] = { PKT_FIELDS(PKT_FIELD_NAME_OF) };
+    return tab[f];
+}
+
+#define PKT_FIELD_BITS(name, sensor, sbits, bits, sgn, shift) + (bits)
+#define PKT_WIN_BITS (0 PKT_FIELDS(PKT_FIELD_BITS))
+#define PKT_WIN_SIZE ((PKT_WIN_BITS + 7) / 8) /* bytes */
+
+#define PKT_FIELD_COUNT(name, sensor, sbits, bits, sgn, shift) + 1
+#define PKT_WIN_NUM_FIELDS (0 PKT_FIELDS(PKT_FIELD_COUNT))
+
+// Statistics of one window (ENABLE_WINDOW_STATS): the min and the max, with
+// the same schema as the window, followed by the log2 of the variance of
+// each field in packed units (i.e. var < 2^lvar), unsigned, saturated.
+#define PKT_STATS_LVAR_BITS 4
+#define PKT_STATS_LVAR_MAX ((1 << PKT_STATS_LVAR_BITS) - 1)
+
+typedef struct {
+    pkt_win_t min;
+    pkt_win_t max;
+    pkt_win_t lvar;
+} pkt_stats_t;
+
+#define PKT_STATS_BITS (2 * PKT_WIN_BITS + PKT_WIN_NUM_FIELDS * PKT_STATS_LVAR_BITS)
+#define PKT_STATS_SIZE ((PKT_STATS_BITS + 7) / 8) /* bytes */
+
+// Magnetometer calibration report (ENABLE_MAG_CAL): the calibration of one
+// axis per packet, in rotation, where
+//     calibrated = (raw - offset) * scale / 2^PKT_CAL_SCALE_SHIFT
+// with the offset in sensor units. Axis PKT_CAL_AXIS_NONE means that there
+// is no calibration yet (raw values are sent).
+#define PKT_CAL_AXIS_BITS   2
+#define PKT_CAL_OFFSET_BITS SENSOR_BITS_MAG
+#define PKT_CAL_SCALE_BITS  8
+#define PKT_CAL_SCALE_SHIFT 6
+#define PKT_CAL_AXIS_NONE   3
+
+typedef struct {
+    int axis;
+    int offset;
+    int scale;
+} pkt_cal_t;
+
+#define PKT_CAL_BITS (PKT_CAL_AXIS_BITS + PKT_CAL_OFFSET_BITS + PKT_CAL_SCALE_BITS)
+#define PKT_CAL_SIZE ((PKT_CAL_BITS + 7) / 8) /* bytes */
+
+// Spectral peaks of the accelerometer (ENABLE_SPECTRUM, see spectrum.h):
+// the strongest local maxima of the power spectrum of the last complete
+// batch, strongest first, preceded by the count of batches modulo 4, which
+// tells a new batch from a repeat. Each peak is the bin k (at frequency
+// k/SPECTRUM_N of the sample rate) and the power summed over the axes, in
+// quarter octaves: power = 2^((code - 1) / 4) (accel LSB^2), 0 if no peak.
+#ifndef PKT_NUM_PEAKS
+#define PKT_NUM_PEAKS 3
+#endif
+#define PKT_PEAKS_SEQ_BITS  2
+#define PKT_PEAK_BIN_BITS   6
+#define PKT_PEAK_POWER_BITS 8
+#define PKT_PEAK_POWER_MAX  ((1 << PKT_PEAK_POWER_BITS) - 1)
+
+typedef struct {
+    int bin;
+    int power;
+} pkt_peak_t;
+
+typedef struct {
+    int seq;
+    pkt_peak_t peak[PKT_NUM_PEAKS];
+} pkt_peaks_t;
+
+#define PKT_PEAKS_BITS (PKT_PEAKS_SEQ_BITS + \
+                        PKT_NUM_PEAKS * (PKT_PEAK_BIN_BITS + PKT_PEAK_POWER_BITS))
+#define PKT_PEAKS_SIZE ((PKT_PEAKS_BITS + 7) / 8) /* bytes */
+
+// Sensor ranges (ENABLE_AUTORANGE): every packed window (and statistics
+// block) comes with a range code byte, that gives the range index at which
+// each sensor was sampled (the largest one over the window). The fields of
+// such a window are scaled by an extra 2^exp, where exp is the exponent of
+// the range relative to the default one:
+//     mag:   HMC5883L gain setting 0..7, exp: see pkt_range_mag_exp()
+//     accel: 0..3 for +-2, 4, 8, 16 g,          exp = index
+//     gyro:  0..4 for +-125, 250, ..., 2000 dps, exp = index
+#define PKT_RANGE_MAG_BITS   3
+#define PKT_RANGE_ACCEL_BITS 2
+#define PKT_RANGE_GYRO_BITS  3
+#define PKT_RANGE_SIZE 1 /* bytes */
+
+#define PKT_RANGE_CODE(mag, accel, gyro) \
+    ((mag) | ((accel) << PKT_RANGE_MAG_BITS) | \
+     ((gyro) << (PKT_RANGE_MAG_BITS + PKT_RANGE_ACCEL_BITS)))
+#define PKT_RANGE_MAG(code)   ((code) & ((1 << PKT_RANGE_MAG_BITS) - 1))
+#define PKT_RANGE_ACCEL(code) (((code) >> PKT_RANGE_MAG_BITS) & ((1 << PKT_RANGE_ACCEL_BITS) - 1))
+#define PKT_RANGE_GYRO(code)  ((code) >> (PKT_RANGE_MAG_BITS + PKT_RANGE_ACCEL_BITS))
+
+/* The gain settings are not powers of two apart: the exponent is the
+ * smallest one that covers the full scale relative to gain 1 (1.3 Ga) */
+static inline unsigned pkt_range_mag_exp(unsigned gain)
+{
+    static const uint8_t exp[1 << PKT_RANGE_MAG_BITS] = { 0, 0, 1, 1, 2, 2, 2, 3 };
+    return exp[gain];
+}
+
+#define PKT_FIELD_CHECK(name, sensor, sbits, bits, sgn, shift) \
+    typedef char pkt_field_width_check_ ## name[(bits) >= 1 && (bits) <= 16 ? 1 : -1];
+PKT_FIELDS(PKT_FIELD_CHECK)
+
+// Bit writer/reader: a 16-bit accumulator that holds fewer than 8 pending
+// bits between calls, so that a put/get of up to 8 bits touches at most one
+// byte of the buffer. Wider fields are split into two byte-sized pieces.
+// The widths are constants at every call site, so the masks, shifts, and
+// the split all fold away.
+
+typedef struct {
+    uint8_t *buf;
+    uint16_t acc;
+    unsigned nbits;
+} pkt_writer_t;
+
+typedef struct {
+    const uint8_t *buf;
+    uint16_t acc;
+    unsigned nbits;
+} pkt_reader_t;
+
+static inline void pkt_put8(pkt_writer_t *w, unsigned v, unsigned width)
+{
+    w->acc |= (uint16_t)((v & ((1u << width) - 1)) << w->nbits);
+    w->nbits += width;
+    if (w->nbits >= 8) {
+        *w->buf++ = (uint8_t)w->acc;
+        w->acc >>= 8;
+        w->nbits -= 8;
+    }
+}
+
+static inline void pkt_put(pkt_writer_t *w, unsigned v, unsigned width)
+{
+    if (width > 8) {
+        pkt_put8(w, v, 8);
+        v >>= 8;
+        width -= 8;
+    }
+    pkt_put8(w, v, width);
+}
+
+// Pad to the byte boundary
+static inline void pkt_put_flush(pkt_writer_t *w)
+{
+    if (w->nbits > 0)
+        *w->buf++ = (uint8_t)w->acc;
+    w->acc = 0;
+    w->nbits = 0;
+}
+
+static inline unsigned pkt_get8(pkt_reader_t *r, unsigned width)
+{
+    if (r->nbits < width) {
+        r->acc |= (uint16_t)(*r->buf++ << r->nbits);
+        r->nbits += 8;
+    }
+    unsigned v = r->acc & ((1u << width) - 1);
+    r->acc >>= width;
+    r->nbits -= width;
+    return v;
+}
+
+static inline int pkt_get(pkt_reader_t *r, unsigned width, int sgn)
+{
+    unsigned v;
+    if (width > 8) {
+        v = pkt_get8(r, 8);
+        v |= pkt_get8(r, width - 8) << 8;
+    } else {
+        v = pkt_get8(r, width);
+    }
+    if (sgn)
+        return (int16_t)(uint16_t)(v << (16 - width)) >> (16 - width);
+    return (int)v;
+}
+
+// Skip the padding up to the byte boundary
+static inline void pkt_get_align(pkt_reader_t *r)
+{
+    r->acc = 0;
+    r->nbits = 0;
+}
+
+// Pack and unpack are expanded per field, so the widths stay constants
+#define PKT_FIELD_PUT(name, sensor, sbits, bits, sgn, shift) \
+    pkt_put(&w, (unsigned)win->v[PKT_F_ ## name], bits);
+#define PKT_FIELD_GET(name, sensor, sbits, bits, sgn, shift) \
+    win->v[PKT_F_ ## name] = pkt_get(&r, bits, sgn);
+#define PKT_FIELD_PUT_LVAR(name, sensor, sbits, bits, sgn, shift) \
+    pkt_put(&w, (unsigned)win->v[PKT_F_ ## name], PKT_STATS_LVAR_BITS);
+#define PKT_FIELD_GET_LVAR(name, sensor, sbits, bits, sgn, shift) \
+    win->v[PKT_F_ ## name] = pkt_get(&r, PKT_STATS_LVAR_BITS, PKT_UNSIGNED);
+
+/* Pack one window into PKT_WIN_SIZE bytes at buf */
+static inline void pkt_win_pack(uint8_t *buf, const pkt_win_t *win)
+{
+    pkt_writer_t w = { buf, 0, 0 };
+    PKT_FIELDS(PKT_FIELD_PUT)
+    pkt_put_flush(&w);
+}
+
+/* Unpack one window from PKT_WIN_SIZE bytes at buf */
+static inline void pkt_win_unpack(const uint8_t *buf, pkt_win_t *win)
+{
+    pkt_reader_t r = { buf, 0, 0 };
+    PKT_FIELDS(PKT_FIELD_GET)
+    pkt_get_align(&r);
+}
+
+/* Scale unpacked values back up to (approximate) sensor units */
+static inline void pkt_win_unscale(const pkt_win_t *win, pkt_win_t *out)
+{
+    for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+        out->v[f] = win->v[f] * (1 << pkt_field_shift(f));
+}
+
+// Composed packets (ENABLE_LINK_BUDGET): the packet starts with a header
+// that gives the levels of the cascade that it carries (bit l of the level
+// mask for level l) and the fields of those windows (bit s of the group
+// mask for the fields of sensor PKT_SENSOR_s). The windows follow, from the
+// lowest level up, each with the fields of its groups only, in schema
+// order, from a byte boundary; then the rest of the packet as without
+// composition, where the range codes (ENABLE_AUTORANGE) are of the windows
+// carried only.
+#define PKT_HDR_SIZE   2 /* bytes */
+#define PKT_HDR_LEVELS 0 /* byte offset of the level mask */
+#define PKT_HDR_GROUPS 1 /* byte offset of the group mask */
+#define PKT_MAX_LEVELS 8
+
+#define PKT_GROUP(sensor) (1u << PKT_SENSOR_ ## sensor)
+#define PKT_FIELD_GROUP_OF(name, sensor, sbits, bits, sgn, shift) | PKT_GROUP(sensor)
+#define PKT_GROUPS_ALL (0 PKT_FIELDS(PKT_FIELD_GROUP_OF))
+
+/* Bytes of a window with the fields of the given groups */
+static inline unsigned pkt_win_size_groups(unsigned groups)
+{
+    unsigned bits = 0;
+    for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+        if (groups & (1u << pkt_field_sensor(f)))
+            bits += pkt_field_bits(f);
+    return (bits + 7) / 8;
+}
+
+#define PKT_FIELD_PUT_GROUP(name, sensor, sbits, bits, sgn, shift) \
+    if (groups & PKT_GROUP(sensor)) \
+        pkt_put(&w, (unsigned)win->v[PKT_F_ ## name], bits);
+#define PKT_FIELD_GET_GROUP(name, sensor, sbits, bits, sgn, shift) \
+    win->v[PKT_F_ ## name] = (groups & PKT_GROUP(sensor)) ? pkt_get(&r, bits, sgn) : 0;
+
+/* Pack the fields of the given groups of one window at buf, returns the
+   bytes written (pkt_win_size_groups) */
+static inline unsigned pkt_win_pack_groups(uint8_t *buf, const pkt_win_t *win, unsigned groups)
+{
+    pkt_writer_t w = { buf, 0, 0 };
+    PKT_FIELDS(PKT_FIELD_PUT_GROUP)
+    pkt_put_flush(&w);
+    return w.buf - buf;
+}
+
+/* Unpack the fields of the given groups of one window from buf (the others
+   are 0), returns the bytes read */
+static inline unsigned pkt_win_unpack_groups(const uint8_t *buf, pkt_win_t *win, unsigned groups)
+{
+    pkt_reader_t r = { buf, 0, 0 };
+    PKT_FIELDS(PKT_FIELD_GET_GROUP)
+    pkt_get_align(&r);
+    return r.buf - buf;
+}
+
+/* Pack the statistics of one window into PKT_STATS_SIZE bytes at buf */
+static inline void pkt_stats_pack(uint8_t *buf, const pkt_stats_t *stats)
+{
+    pkt_writer_t w = { buf, 0, 0 };
+    const pkt_win_t *win;
+
+    win = &stats->min;
+    PKT_FIELDS(PKT_FIELD_PUT)
+    win = &stats->max;
+    PKT_FIELDS(PKT_FIELD_PUT)
+    win = &stats->lvar;
+    PKT_FIELDS(PKT_FIELD_PUT_LVAR)
+    pkt_put_flush(&w);
+}
+
+/* Unpack the statistics of one window from PKT_STATS_SIZE bytes at buf */
+static inline void pkt_stats_unpack(const uint8_t *buf, pkt_stats_t *stats)
+{
+    pkt_reader_t r = { buf, 0, 0 };
+    pkt_win_t *win;
+
+    win = &stats->min;
+    PKT_FIELDS(PKT_FIELD_GET)
+    win = &stats->max;
+    PKT_FIELDS(PKT_FIELD_GET)
+    win = &stats->lvar;
+    PKT_FIELDS(PKT_FIELD_GET_LVAR)
+    pkt_get_align(&r);
+}
+
+/* Exponent of the range of the given sensor in the range code */
+static inline unsigned pkt_range_exp(unsigned sensor, unsigned code)
+{
+    switch (sensor) {
+        case PKT_SENSOR_MAG:   return pkt_range_mag_exp(PKT_RANGE_MAG(code));
+        case PKT_SENSOR_ACCEL: return PKT_RANGE_ACCEL(code);
+        case PKT_SENSOR_GYRO:  return PKT_RANGE_GYRO(code);
+        default:               return 0;
+    }
+}
+
+/* Scale the unscaled fields of a window further up by its sensor ranges */
+static inline void pkt_win_unscale_range(pkt_win_t *win, unsigned code)
+{
+    for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+        win->v[f] *= 1 << pkt_range_exp(pkt_field_sensor(f), code);
+}
+
+static inline void pkt_cal_pack(uint8_t *buf, const pkt_cal_t *cal)
+{
+    pkt_writer_t w = { buf, 0, 0 };
+    pkt_put(&w, (unsigned)cal->axis, PKT_CAL_AXIS_BITS);
+    pkt_put(&w, (unsigned)cal->offset, PKT_CAL_OFFSET_BITS);
+    pkt_put(&w, (unsigned)cal->scale, PKT_CAL_SCALE_BITS);
+    pkt_put_flush(&w);
+}
+
+static inline void pkt_cal_unpack(const uint8_t *buf, pkt_cal_t *cal)
+{
+    pkt_reader_t r = { buf, 0, 0 };
+    cal->axis = pkt_get(&r, PKT_CAL_AXIS_BITS, PKT_UNSIGNED);
+    cal->offset = pkt_get(&r, PKT_CAL_OFFSET_BITS, PKT_SIGNED);
+    cal->scale = pkt_get(&r, PKT_CAL_SCALE_BITS, PKT_UNSIGNED);
+    pkt_get_align(&r);
+}
+
+static inline void pkt_peaks_pack(uint8_t *buf, const pkt_peaks_t *peaks)
+{
+    pkt_writer_t w = { buf, 0, 0 };
+    pkt_put(&w, (unsigned)peaks->seq, PKT_PEAKS_SEQ_BITS);
+    for (unsigned i = 0; i < PKT_NUM_PEAKS; ++i) {
+        pkt_put(&w, (unsigned)peaks->peak[i].bin, PKT_PEAK_BIN_BITS);
+        pkt_put(&w, (unsigned)peaks->peak[i].power, PKT_PEAK_POWER_BITS);
+    }
+    pkt_put_flush(&w);
+}
+
+static inline void pkt_peaks_unpack(const uint8_t *buf, pkt_peaks_t *peaks)
+{
+    pkt_reader_t r = { buf, 0, 0 };
+    peaks->seq = pkt_get(&r, PKT_PEAKS_SEQ_BITS, PKT_UNSIGNED);
+    for (unsigned i = 0; i < PKT_NUM_PEAKS; ++i) {
+        peaks->peak[i].bin = pkt_get(&r, PKT_PEAK_BIN_BITS, PKT_UNSIGNED);
+        peaks->peak[i].power = pkt_get(&r, PKT_PEAK_POWER_BITS, PKT_UNSIGNED);
+    }
+    pkt_get_align(&r);
+}
+
+#endif // PKT_H
@@ -0,0 +1,138 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libio/console.h>
+
+#include "powermode.h"
+#include "autorange.h"
+#include "i2c.h"
+
+// With the sample clock, samples must be at least one period of the low
+// ODR apart (see lsm.c)
+#if defined(ENABLE_SAMPLE_CLOCK) && SAMPLE_CLOCK_HZ > 12
+#error SAMPLE_CLOCK_HZ must not exceed the low LSM ODR (12.5 Hz)
+#endif
+
+// LSB per g and per dps of the readings: normalized with ENABLE_AUTORANGE
+// (see autorange.h), else raw at the ranges set by lsm_init (+-2 g, +-125 dps)
+#ifdef ENABLE_AUTORANGE
+#define ACCEL_LSB_PER_G  (16384 >> AUTORANGE_ACCEL_NORM_SHIFT)
+#define GYRO_LSB_PER_DPS (229 >> AUTORANGE_GYRO_NORM_SHIFT)
+#else // !ENABLE_AUTORANGE
+#define ACCEL_LSB_PER_G  16384
+#define GYRO_LSB_PER_DPS 229
+#endif // !ENABLE_AUTORANGE
+
+#define WAKE_LSB  ((unsigned)((uint32_t)POWER_WAKE_MG * ACCEL_LSB_PER_G / 1000))
+#define QUIET_LSB ((unsigned)((uint32_t)POWER_QUIET_MG * ACCEL_LSB_PER_G / 1000))
+#define QUIET_GYRO_LSB ((unsigned)POWER_QUIET_DPS * GYRO_LSB_PER_DPS)
+
+// LSM ODR by mode
+static const unsigned mode_odr[] = { LSM_ODR_LOW, LSM_ODR_HIGH };
+
+static inline unsigned absu(int v)
+{
+  return v < 0 ? -(unsigned)v : (unsigned)v;
+}
+
+static inline unsigned dist(int a, int b)
+{
+  return a > b ? (unsigned)a - (unsigned)b : (unsigned)b - (unsigned)a;
+}
+
+static void set_mode(powermode_t *pm, uint8_t mode)
+{
+  uint8_t old = pm->mode;
+
+  pm->mode = mode;
+  pm->count = 0;
+  LOG("[powermode] mode %u\r\n", mode);
+
+  // On failure, stay in the old mode: the controller tries again later
+  if (lsm_set_odr(mode_odr[mode]) != I2C_OK) {
+    pm->mode = old;
+    lsm_set_odr(mode_odr[old]);
+  }
+}
+
+/* Initial state: active, as set by lsm_init() */
+void powermode_init(powermode_t *pm)
+{
+  pm->mode = POWER_MODE_ACTIVE;
+  pm->count = 0;
+  pm->mag_count = 0;
+}
+
+/* Bring the LSM to the committed mode (on the first sample after a boot,
+ * which is after its init and after autorange_init). The ODR is written
+ * anyway, in case a reboot cut a change short or rolled it back. */
+void powermode_resume(const powermode_t *pm, bool lsm_ok)
+{
+  if (lsm_ok)
+    lsm_set_odr(mode_odr[pm->mode]);
+}
+
+uint8_t powermode_get(const powermode_t *pm)
+{
+  return pm->mode;
+}
+
+/* Whether to measure the magnetic field for the sample being taken (call
+ * once per sample) */
+bool powermode_mag_due(powermode_t *pm)
+{
+  if (pm->mode == POWER_MODE_ACTIVE || ++pm->mag_count >= POWER_QUIET_MAG_DIV) {
+    pm->mag_count = 0;
+    return true;
+  }
+  return false;
+}
+
+/* Update the controller with an LSM reading, and switch the mode */
+void powermode_accel(powermode_t *pm, const lsm_t *s)
+{
+  const int a[3] = { s->ax, s->ay, s->az };
+  unsigned i;
+
+  if (pm->mode == POWER_MODE_QUIET) {
+    for (i = 0; i < 3; ++i) {
+      if (dist(a[i], pm->ref[i]) > WAKE_LSB) {
+        set_mode(pm, POWER_MODE_ACTIVE);
+        return;
+      }
+    }
+    return;
+  }
+
+  if (pm->count == 0)
+    pm->gpeak = 0;
+  for (i = 0; i < 3; ++i) {
+    if (pm->count == 0 || a[i] < pm->min[i])
+      pm->min[i] = a[i];
+    if (pm->count == 0 || a[i] > pm->max[i])
+      pm->max[i] = a[i];
+  }
+#ifdef ENABLE_GYRO
+  const int g[3] = { s->gx, s->gy, s->gz };
+  for (i = 0; i < 3; ++i) {
+    if (absu(g[i]) > pm->gpeak)
+      pm->gpeak = absu(g[i]);
+  }
+#endif // ENABLE_GYRO
+
+  if (++pm->count < POWER_HOLD)
+    return;
+
+  pm->count = 0;
+  if (pm->gpeak >= QUIET_GYRO_LSB)
+    return;
+  for (i = 0; i < 3; ++i) {
+    if (dist(pm->max[i], pm->min[i]) >= QUIET_LSB)
+      return;
+  }
+
+  for (i = 0; i < 3; ++i)
+    pm->ref[i] = a[i];
+  pm->mag_count = 0;
+  set_mode(pm, POWER_MODE_QUIET);
+}
@@ -0,0 +1,70 @@
+#ifndef POWERMODE_H
+#define POWERMODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lsm.h"
+
+// Activity-adaptive power modes of the sensors.
+//
+// Quiet mode: the LSM runs at its low ODR (accel 12.5 Hz, gyro powered
+// down, so the gyro readings are zero), and the magnetometer makes a
+// measurement only every POWER_QUIET_MAG_DIV samples (it idles in between,
+// and the last reading is repeated). Without the sample clock, the wait for
+// an LSM sample follows the ODR, so samples are also further apart. Active
+// mode: the sensors run as without ENABLE_POWER_MODES.
+//
+// Controller, on each LSM reading: go active as soon as the acceleration
+// changes by more than POWER_WAKE_MG on some axis from the reading taken
+// when the mode went quiet (the reference is that reading rather than 1 g,
+// which does not hold in free fall); go quiet when, over POWER_HOLD
+// readings, the peak-to-peak of every axis stays under POWER_QUIET_MG (and
+// the rate of every gyro axis under POWER_QUIET_DPS).
+//
+// The state of the controller belongs to the caller, which keeps it in a
+// channel (the self channel of task_sample), so that a re-executed task
+// starts over from the state it committed last. The sensor registers are
+// not rolled back with it: powermode_resume() writes the ODR of the
+// committed mode after each boot.
+
+#ifndef POWER_WAKE_MG
+#define POWER_WAKE_MG 100
+#endif
+
+#ifndef POWER_QUIET_MG
+#define POWER_QUIET_MG 30
+#endif
+
+#ifndef POWER_QUIET_DPS
+#define POWER_QUIET_DPS 5
+#endif
+
+#ifndef POWER_HOLD
+#define POWER_HOLD 16
+#endif
+
+#ifndef POWER_QUIET_MAG_DIV
+#define POWER_QUIET_MAG_DIV 4
+#endif
+
+#define POWER_MODE_QUIET  0
+#define POWER_MODE_ACTIVE 1
+
+typedef struct {
+  uint8_t mode;       // set in the sensors
+  int ref[3];         // accel when the mode went quiet
+  int min[3];         // accel since the last decision (in active mode)
+  int max[3];
+  unsigned gpeak;     // largest gyro rate since the last decision
+  unsigned count;     // readings since the last decision
+  unsigned mag_count; // samples since the last magnetometer measurement
+} powermode_t;
+
+void powermode_init(powermode_t *pm);
+void powermode_resume(const powermode_t *pm, bool lsm_ok);
+uint8_t powermode_get(const powermode_t *pm);
+bool powermode_mag_due(powermode_t *pm);
+void powermode_accel(powermode_t *pm, const lsm_t *s);
+
+#endif // POWERMODE_H
@@ -0,0 +1,58 @@
+#include <msp430.h>
+#include <stdbool.h>
+
+#include <libmsp/mem.h>
+
+#include "sample_clock.h"
+
+#ifndef CLOCK_FREQ_ACLK
+#define CLOCK_FREQ_ACLK 32768
+#endif
+
+#define SAMPLE_CLOCK_PERIOD (CLOCK_FREQ_ACLK / SAMPLE_CLOCK_HZ) /* ACLK cycles */
+
+#if SAMPLE_CLOCK_PERIOD > 0xffff || SAMPLE_CLOCK_PERIOD < 2
+#error SAMPLE_CLOCK_HZ out of range for a 16-bit timer on ACLK
+#endif
+
+static __nv volatile sample_tick_t ticks = 0;
+static volatile bool tick_pending = false;
+
+// Timer A1 (A0 is the libmsp sleep timer), up mode, on ACLK (runs in LPM3)
+void sample_clock_init()
+{
+  TA1CCR0 = SAMPLE_CLOCK_PERIOD - 1;
+  TA1CCTL0 = CCIE;
+  TA1CTL = TASSEL__ACLK | MC__UP | TACLR;
+}
+
+// Sleep in LPM3 until the next tick that has not been consumed yet, and
+// return its count. If the app overran a period, returns immediately (the
+// skipped ticks show up as a gap in the stamps).
+sample_tick_t sample_clock_wait()
+{
+  __disable_interrupt();
+  while (!tick_pending) {
+    __bis_SR_register(LPM3_bits | GIE); // atomically enables ints and sleeps
+    __disable_interrupt();
+  }
+  tick_pending = false;
+  sample_tick_t tick = ticks;
+  __enable_interrupt();
+  return tick;
+}
+
+// Whether a tick is due, i.e. whether sample_clock_wait() would return
+// without sleeping
+bool sample_clock_pending()
+{
+  return tick_pending;
+}
+
+__attribute__ ((interrupt(TIMER1_A0_VECTOR)))
+void TIMER1_A0_ISR(void)
+{
+  ++ticks;
+  tick_pending = true;
+  __bic_SR_register_on_exit(LPM3_bits);
+}
@@ -0,0 +1,21 @@
+#ifndef SAMPLE_CLOCK_H
+#define SAMPLE_CLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Fixed-rate sample clock: a timer on ACLK ticks at SAMPLE_CLOCK_HZ and the
+// CPU idles in LPM3 between ticks. The tick count is kept in FRAM, so that
+// the stamps stay monotonic across reboots (time spent off is not counted).
+
+#ifndef SAMPLE_CLOCK_HZ
+#define SAMPLE_CLOCK_HZ 8
+#endif
+
+typedef uint16_t sample_tick_t;
+
+void sample_clock_init();
+sample_tick_t sample_clock_wait();
+bool sample_clock_pending();
+
+#endif // SAMPLE_CLOCK_H
@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "spectrum.h"
+
+#define COEF_SHIFT 12
+#define POWER_BITS 14 // of the state, when computing the power
+
+// 2cos(2pi j/64) in Q12, for j = 0..16
+static const int16_t cos_tab[17] = {
+  8192, 8153, 8035, 7839, 7568, 7225, 6811, 6333,
+  5793, 5197, 4551, 3862, 3135, 2378, 1598,  803,
+     0,
+};
+
+/* Goertzel coefficient of bin k: 2cos(2pi k/N) in Q12 */
+static int coef(unsigned k)
+{
+  unsigned j = k * (64 / SPECTRUM_N); // in 1..32
+  return j <= 16 ? cos_tab[j] : -cos_tab[32 - j];
+}
+
+/* c * s / 2^12, rounded down, in 32 bits: s is split at bit 12, so that
+   neither product overflows as long as |s| < 2^30 */
+static inline long mul_coef(int c, long s)
+{
+  long hi = s >> COEF_SHIFT;
+  long lo = s & ((1L << COEF_SHIFT) - 1);
+  return c * hi + ((c * lo) >> COEF_SHIFT);
+}
+
+/* Update bin k with the next sample: s = x + c s[n-1] - s[n-2]. The first
+   sample of a batch starts the state from zero and becomes the pivot. */
+void spectrum_step(spectrum_bin_t *bin, unsigned k, const spectrum_in_t *x,
+                   const spectrum_in_t *pivot, bool first)
+{
+  int c = coef(k);
+
+  for (unsigned a = 0; a < SPECTRUM_AXES; ++a) {
+    long in = (long)x->v[a] - pivot->v[a];
+    long s1 = first ? 0 : bin->s1[a];
+    long s2 = first ? 0 : bin->s2[a];
+
+    bin->s2[a] = s1;
+    bin->s1[a] = in + mul_coef(c, s1) - s2;
+  }
+}
+
+static unsigned bitlen(unsigned long v)
+{
+  unsigned n = 0;
+  while (v) {
+    ++n;
+    v >>= 1;
+  }
+  return n;
+}
+
+/* log2 in quarter octaves, as in the packet: 0 for 0, else 1 + 4 log2(p),
+   with the fraction interpolated from the two bits after the leading one */
+static unsigned log2q(unsigned long p, unsigned extra_octaves)
+{
+  unsigned n = bitlen(p);
+  if (n == 0)
+    return 0;
+  unsigned frac = n >= 3 ? (p >> (n - 3)) & 0x3 : (p << (3 - n)) & 0x3;
+  unsigned q = 1 + 4 * (n - 1 + extra_octaves) + frac;
+  return q > PKT_PEAK_POWER_MAX ? PKT_PEAK_POWER_MAX : q;
+}
+
+/* Power of bin k at the end of a batch, summed over the axes:
+   |X|^2 = s1^2 + s2^2 - c s1 s2. The state of all axes is scaled by a
+   common shift down to POWER_BITS first (block floating point), so the
+   products fit in 32 bits, and the shift goes back in the exponent. */
+uint8_t spectrum_power(const spectrum_bin_t *bin, unsigned k)
+{
+  int c = coef(k);
+
+  unsigned long m = 0; // has the bit length of the largest magnitude
+  for (unsigned a = 0; a < SPECTRUM_AXES; ++a) {
+    m |= bin->s1[a] < 0 ? -bin->s1[a] : bin->s1[a];
+    m |= bin->s2[a] < 0 ? -bin->s2[a] : bin->s2[a];
+  }
+  unsigned n = bitlen(m);
+  unsigned shift = n > POWER_BITS ? n - POWER_BITS : 0;
+
+  unsigned long p = 0;
+  for (unsigned a = 0; a < SPECTRUM_AXES; ++a) {
+    long s1 = bin->s1[a] >> shift;
+    long s2 = bin->s2[a] >> shift;
+    long pa = s1 * s1 + s2 * s2 - mul_coef(c, s1) * s2;
+    if (pa > 0) // can be slightly negative from the rounding
+      p += pa;
+  }
+  return log2q(p, 2 * shift);
+}
+
+/* Pick the strongest local maxima of the power (indexed by bin - 1),
+   strongest first. Unused entries have power 0. */
+void spectrum_peaks(const uint8_t *power, pkt_peaks_t *peaks)
+{
+  for (unsigned i = 0; i < PKT_NUM_PEAKS; ++i) {
+    peaks->peak[i].bin = 0;
+    peaks->peak[i].power = 0;
+  }
+
+  for (unsigned b = 0; b < SPECTRUM_BINS; ++b) {
+    unsigned p = power[b];
+    if (p == 0 ||
+        (b > 0 && power[b - 1] >= p) ||
+        (b + 1 < SPECTRUM_BINS && power[b + 1] > p))
+      continue;
+
+    // Insertion into the sorted list, dropping the weakest
+    unsigned i = PKT_NUM_PEAKS;
+    while (i > 0 && peaks->peak[i - 1].power < (int)p) {
+      if (i < PKT_NUM_PEAKS)
+        peaks->peak[i] = peaks->peak[i - 1];
+      --i;
+    }
+    if (i < PKT_NUM_PEAKS) {
+      peaks->peak[i].bin = b + 1;
+      peaks->peak[i].power = p;
+    }
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pkt.h"
+
+// Spectral peaks of the accelerometer, from a fixed-point Goertzel bank.
+//
+// The samples are taken in batches of SPECTRUM_N, and every sample updates
+// the Goertzel state of bins 1..N/2 (frequency k/N of the sample rate) on
+// each axis, so the work is spread evenly over the sampling tasks and no
+// batch of raw samples is kept. At the end of a batch, the power of each
+// bin, summed over the axes, is compared across bins, and the strongest
+// local maxima are reported (see pkt.h). The window is rectangular.
+//
+// The input is taken relative to the first sample of the batch, which
+// removes most of the gravity offset, so the state is bounded by
+// N * 2^17 / sin(pi/N) < 2^27 for N <= 64, and the coefficient multiply is
+// split so that it doesn't need more than 32 bits.
+//
+// Nothing here keeps state: the caller holds the bins in channels.
+
+#ifndef SPECTRUM_N
+#define SPECTRUM_N 32
+#endif
+
+#define SPECTRUM_AXES 3
+
+// SPECTRUM_N / 2, bin k is at index k - 1 (libchain needs a literal number)
+#if SPECTRUM_N == 16
+#define SPECTRUM_BINS 8
+#elif SPECTRUM_N == 32
+#define SPECTRUM_BINS 16
+#elif SPECTRUM_N == 64
+#define SPECTRUM_BINS 32
+#else
+#error SPECTRUM_N must be 16, 32, or 64
+#endif
+
+#if SPECTRUM_BINS >= (1 << PKT_PEAK_BIN_BITS)
+#error Bin index does not fit in PKT_PEAK_BIN_BITS
+#endif
+
+typedef struct {
+  long s1[SPECTRUM_AXES]; // s[n-1]
+  long s2[SPECTRUM_AXES]; // s[n-2]
+} spectrum_bin_t;
+
+typedef struct {
+  int16_t v[SPECTRUM_AXES];
+} spectrum_in_t;
+
+void spectrum_step(spectrum_bin_t *bin, unsigned k, const spectrum_in_t *x,
+                   const spectrum_in_t *pivot, bool first);
+uint8_t spectrum_power(const spectrum_bin_t *bin, unsigned k);
+void spectrum_peaks(const uint8_t *power, pkt_peaks_t *peaks);
+
+#endif // SPECTRUM_H
@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <libio/console.h>
+
+#include "i2c.h"
+
+// Sensor traces (ENABLE_TRACE): every sensor reading, as returned by the
+// driver, and every boot go to the console as records, so that a capture
+// of a run can be replayed through the app on the host (see bld/replay).
+//
+// One record per line, after the "trace: " prefix (other lines are not
+// records, so the whole console capture can be fed to the replay):
+//
+//     b <task> <mag_ok> <lsm_ok> <mag_warm> <lsm_warm>
+//                                 boot, at the end of the init: the task
+//                                 in progress (the entry task on the first
+//                                 boot), which sensors came up, and which
+//                                 were found still configured (warm, with
+//                                 ENABLE_WARM_BOOT; the replay also takes
+//                                 records without the warm flags, as cold)
+//     t <temp>                    read_temperature_sensor()
+//     m <x> <y> <z>               magnetometer_read()
+//     l <ax> <ay> <az> <gx> <gy> <gz>
+//                                 lsm_sample() (gyro 0 without ENABLE_GYRO)
+//     m ! <rc>, l ! <rc>          a read that failed with the given error
+//
+// Values are decimal, in raw sensor units (before any normalization or
+// calibration in the app).
+
+#define TRACE_PREFIX "trace: "
+
+#ifdef ENABLE_TRACE
+
+#define TRACE(...) LOG(TRACE_PREFIX __VA_ARGS__)
+
+#define TRACE_BOOT(task, mag_ok, lsm_ok, mag_warm, lsm_warm) \
+    TRACE("b %u %u %u %u %u\r\n", (unsigned)(task), (unsigned)(mag_ok), (unsigned)(lsm_ok), \
+          (unsigned)(mag_warm), (unsigned)(lsm_warm))
+
+#define TRACE_TEMP(temp) TRACE("t %i\r\n", (int)(temp))
+
+#define TRACE_MAG(rc, m) do { \
+        if ((rc) == I2C_OK) \
+            TRACE("m %i %i %i\r\n", (m)->x, (m)->y, (m)->z); \
+        else \
+            TRACE("m ! %i\r\n", (rc)); \
+    } while (0)
+
+#define TRACE_LSM(rc, s) do { \
+        if ((rc) == I2C_OK) \
+            TRACE("l %i %i %i %i %i %i\r\n", \
+                  (s)->ax, (s)->ay, (s)->az, (s)->gx, (s)->gy, (s)->gz); \
+        else \
+            TRACE("l ! %i\r\n", (rc)); \
+    } while (0)
+
+#else // !ENABLE_TRACE
+
+#define TRACE_BOOT(task, mag_ok, lsm_ok, mag_warm, lsm_warm)
+#define TRACE_TEMP(temp)
+#define TRACE_MAG(rc, m)
+#define TRACE_LSM(rc, s)
+
+#endif // !ENABLE_TRACE
+
+#endif // TRACE_H
@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "txq.h"
+
+#define TXQ_MAX_LEVEL 15
+
+static unsigned txq_score(const txq_meta_t *e)
+{
+  unsigned level = 0;
+  uint16_t seq = e->seq;
+  while (level < TXQ_MAX_LEVEL && !(seq & 0x1)) {
+    seq >>= 1;
+    ++level;
+  }
+  return ((e->flags & TXQ_EVENT) ? TXQ_MAX_LEVEL + 1 : 0) + level;
+}
+
+// Sequence numbers wrap around, so compare by distance
+static bool txq_older(const txq_meta_t *a, const txq_meta_t *b)
+{
+  return (int16_t)(a->seq - b->seq) < 0;
+}
+
+int txq_next(const txq_meta_t *q, unsigned n)
+{
+  int best = -1;
+  unsigned best_score = 0;
+
+  for (unsigned i = 0; i < n; ++i) {
+    if (!(q[i].flags & TXQ_VALID))
+      continue;
+    unsigned score = txq_score(&q[i]);
+    if (best < 0 || score > best_score ||
+        (score == best_score && txq_older(&q[best], &q[i]))) {
+      best = i;
+      best_score = score;
+    }
+  }
+  return best;
+}
+
+int txq_slot(const txq_meta_t *q, unsigned n, const txq_meta_t *incoming)
+{
+  int victim = -1;
+
+  for (unsigned i = 0; i < n; ++i) {
+    if (!(q[i].flags & TXQ_VALID))
+      return i;
+  }
+
+#if defined(TXQ_EVICT_THIN)
+
+  unsigned victim_score = 0;
+  for (unsigned i = 0; i < n; ++i) {
+    unsigned score = txq_score(&q[i]);
+    if (victim < 0 || score < victim_score ||
+        (score == victim_score && txq_older(&q[i], &q[victim]))) {
+      victim = i;
+      victim_score = score;
+    }
+  }
+  if (txq_score(incoming) < victim_score)
+    return -1;
+
+#else // TXQ_EVICT_OLDEST
+
+  for (unsigned i = 0; i < n; ++i) {
+    if (q[i].flags & TXQ_EVENT)
+      continue;
+    if (victim < 0 || txq_older(&q[i], &q[victim]))
+      victim = i;
+  }
+  if (victim < 0) { // all events
+    if (!(incoming->flags & TXQ_EVENT))
+      return -1;
+    for (unsigned i = 0; i < n; ++i) {
+      if (victim < 0 || txq_older(&q[i], &q[victim]))
+        victim = i;
+    }
+  }
+
+#endif // TXQ_EVICT_*
+
+  return victim;
+}
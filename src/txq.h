@@ -0,0 +1,63 @@
+#ifndef TXQ_H
+#define TXQ_H
+
+// Policy for the downlink queue (ENABLE_TXQ): which queued packet to send
+// next and which one to evict when the queue is full. Only the metadata of
+// the entries is looked at; the packets themselves stay in the channel.
+//
+// Value of a packet, highest first:
+//   - event: the packet was flagged by task_pack as unusual,
+//   - timescale: the number of trailing zero bits of its sequence number,
+//     so that thinning keeps every 2nd, then every 4th, ... packet and the
+//     long-term record survives with coarser resolution,
+//   - age: among equals, newer packets are sent first and older ones are
+//     evicted first.
+//
+// Eviction policies (TXQ_EVICT_*):
+//   OLDEST: evict the oldest packet, sparing events
+//   THIN:   evict the lowest-value packet (the incoming one included)
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef TXQ_SIZE
+#define TXQ_SIZE 8 /* packets (a literal number, for libchain) */
+#endif
+
+// Transmit opportunity: every TXQ_TX_INTERVAL cycles, send up to
+// TXQ_TX_BURST packets from the queue
+#ifndef TXQ_TX_INTERVAL
+#define TXQ_TX_INTERVAL 1
+#endif
+#ifndef TXQ_TX_BURST
+#define TXQ_TX_BURST 1
+#endif
+
+/* Departure of the shortest from the longest timescale, in packed units,
+ * that flags the packet as an event */
+#ifndef TXQ_EVENT_THRESHOLD
+#define TXQ_EVENT_THRESHOLD 2
+#endif
+
+#if TXQ_SIZE > 16
+#error TXQ_SIZE must fit in a bitmask (<= 16)
+#endif
+
+#define TXQ_VALID 0x1
+#define TXQ_EVENT 0x2
+
+#define TXQ_SEQ_MASK 0x7fff /* on the wire, the top bit carries the event flag */
+
+typedef struct {
+    uint16_t seq;
+    uint8_t flags;
+} txq_meta_t;
+
+/* Returns the index of the entry to send next, or -1 if queue is empty */
+int txq_next(const txq_meta_t *q, unsigned n);
+
+/* Returns the index of a free entry, or of the entry to evict for the
+ * incoming one, or -1 if the incoming one should be dropped instead */
+int txq_slot(const txq_meta_t *q, unsigned n, const txq_meta_t *incoming);
+
+#endif // TXQ_H
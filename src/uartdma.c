@@ -0,0 +1,106 @@
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libmsp/mem.h>
+#include <libmspuartlink/uartlink.h>
+
+#include "uartdma.h"
+
+// Assumes LIBMSPUARTLINK_UART_IDX = 0 (eUSCI_A0)
+#define UARTDMA_TRIGGER DMA0TSEL_15 /* UCA0TXIFG */
+
+static __nv const uint8_t * volatile tx_buf;
+static __nv volatile unsigned tx_len;
+static __nv volatile bool tx_busy = false; // from start until drained
+
+static volatile bool dma_done;
+
+static void start(void)
+{
+  uartlink_open_tx();
+
+  if (tx_len > 1) {
+    dma_done = false;
+
+    // The DMA is triggered by the rising edge of UCTXIFG, which is
+    // already high: so, the first byte is written by hand and the
+    // DMA moves the rest as the UART frees up.
+    DMACTL0 = (DMACTL0 & 0xff00) | UARTDMA_TRIGGER;
+    __data16_write_addr((unsigned short)&DMA0SA, (unsigned long)(tx_buf + 1));
+    __data16_write_addr((unsigned short)&DMA0DA, (unsigned long)&UCA0TXBUF);
+    DMA0SZ = tx_len - 1;
+    DMA0CTL = DMADT_0 | DMASRCINCR_3 | DMADSTINCR_0 | DMASBDB | DMAIE | DMAEN;
+  } else {
+    dma_done = true;
+  }
+
+  UCA0TXBUF = tx_buf[0];
+}
+
+/* Start sending the buffer and return right away */
+void uartdma_send(const uint8_t *buf, unsigned len)
+{
+  uartdma_wait();
+
+  if (len == 0)
+    return;
+
+  tx_buf = buf;
+  tx_len = len;
+  tx_busy = true;
+  start();
+}
+
+/* Restart a transmission that was cut by a reboot (call on boot) */
+void uartdma_resume(void)
+{
+  if (tx_busy)
+    start();
+}
+
+bool uartdma_busy(void)
+{
+  return tx_busy && !(dma_done && !(UCA0STATW & UCBUSY));
+}
+
+/* Bytes of the transmission that the DMA has yet to move (the one or two
+   in the UART do not count): the backlog of the link */
+unsigned uartdma_pending(void)
+{
+  if (!tx_busy || dma_done)
+    return 0;
+  return DMA0SZ;
+}
+
+/* Sleep until the last byte is out, then release the UART */
+void uartdma_wait(void)
+{
+  if (!tx_busy)
+    return;
+
+  __disable_interrupt();
+  while (!dma_done) {
+    __bis_SR_register(LPM3_bits | GIE); // DMA turns on MCLK by itself
+    __disable_interrupt();
+  }
+  __enable_interrupt();
+
+  while (UCA0STATW & UCBUSY); // last byte, at most one char time
+
+  uartlink_close();
+  tx_busy = false;
+}
+
+__attribute__ ((interrupt(DMA_VECTOR)))
+void DMA_ISR(void)
+{
+  switch (__even_in_range(DMAIV, DMAIV_DMA2IFG)) {
+    case DMAIV_DMA0IFG:
+      dma_done = true;
+      __bic_SR_register_on_exit(LPM3_bits);
+      break;
+    default:
+      break;
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef UARTDMA_H
+#define UARTDMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Non-blocking transmission on the uartlink UART (eUSCI_A0): the bytes are
+// fed to UCA0TXBUF by DMA channel 0 while the CPU goes on or sleeps.
+//
+// The buffer must stay untouched until the transmission is over, and it
+// should be in FRAM: the state of the transmission is kept in FRAM, and a
+// transmission cut by a reboot is restarted from its first byte by
+// uartdma_resume(). (The receiver sees a truncated frame followed by the
+// whole frame, which the link CRC sorts out.)
+
+void uartdma_send(const uint8_t *buf, unsigned len);
+void uartdma_wait(void);
+bool uartdma_busy(void);
+unsigned uartdma_pending(void);
+void uartdma_resume(void);
+
+#endif // UARTDMA_H
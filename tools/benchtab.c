@@ -0,0 +1,106 @@
+// Host-side printer for the cycle counts of a benchmark build (ENABLE_BENCH,
+// see src/bench.h).
+//
+// Reads the output of the mspdebug 'md bench_results <size>' command (the
+// lines of the hex dump, i.e. "addr: bytes |ascii|"; other lines are
+// ignored), and prints one row per point that ran: the count of runs and
+// the min, average and max cycles per run. The table has fixed columns and
+// no run-specific data, so the tables of two builds can be diffed.
+//
+// The last line is the cost of a packet, i.e. of a full cycle of the
+// cascade: the cycles of all the tasks but task_init, per task_send.
+//
+// Usage: benchtab [-n] [file]
+//    -n    print the size of bench_results (for the 'md' command) and exit
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define RESULTS_SIZE (BENCH_NUM * 4 * 4) /* bench_stat_t: four 32-bit fields */
+
+static uint8_t results[RESULTS_SIZE];
+static unsigned results_len;
+
+/* Collect the bytes of one line of a hex dump */
+static void parse_line(const char *line)
+{
+    // Only dump lines carry the ASCII column
+    const char *end = strchr(line, '|');
+    const char *p = strchr(line, ':');
+    if (!end || !p || p > end)
+        return;
+
+    for (++p; p < end && results_len < RESULTS_SIZE; ) {
+        while (p < end && isspace((unsigned char)*p))
+            ++p;
+        if (p + 2 > end || !isxdigit((unsigned char)p[0]) ||
+            !isxdigit((unsigned char)p[1]) ||
+            (p + 2 < end && !isspace((unsigned char)p[2])))
+            break;
+        results[results_len++] = strtoul((char[]){ p[0], p[1], '\0' }, NULL, 16);
+        p += 2;
+    }
+}
+
+/* Little-endian, as on the MSP430 */
+static uint32_t get32(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "n")) != -1) {
+        switch (c) {
+            case 'n':
+                printf("%u\n", RESULTS_SIZE);
+                return 0;
+            default:
+                fprintf(stderr, "usage: %s [-n] [file]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    FILE *in = stdin;
+    if (optind < argc) {
+        in = fopen(argv[optind], "r");
+        if (!in) {
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), in))
+        parse_line(line);
+
+    if (results_len < RESULTS_SIZE) {
+        fprintf(stderr, "short dump: %u of %u bytes\n", results_len, RESULTS_SIZE);
+        return 1;
+    }
+
+    unsigned long long task_total = 0;
+    printf("%-26s %8s %10s %10s %10s\n", "point", "count", "min", "avg", "max");
+    for (unsigned i = 0; i < BENCH_NUM; ++i) {
+        const uint8_t *b = results + i * 16;
+        bench_stat_t s = { get32(b), get32(b + 4), get32(b + 8), get32(b + 12) };
+        if (s.count == 0)
+            continue;
+        printf("%-26s %8lu %10lu %10lu %10lu\n", bench_name(i),
+               (unsigned long)s.count, (unsigned long)s.min,
+               (unsigned long)(s.total / s.count), (unsigned long)s.max);
+        if (i < BENCH_empty && i != BENCH_task_init)
+            task_total += s.total;
+    }
+
+    uint32_t packets = get32(results + BENCH_task_send * 16);
+    if (packets > 0)
+        printf("cycles/packet %lu\n", (unsigned long)(task_total / packets));
+    return 0;
+}
@@ -0,0 +1,451 @@
+// Host-side decoder for frames captured from the radio link.
+//
+// Reads the raw byte stream received from the radio (binary; a hex dump
+// can be converted with 'xxd -r -p'), splits it into frames, undoes the
+// FEC, verifies the CRC, prints the windows in each valid frame, and
+// reports the effective goodput: payload bytes of valid frames per byte
+// received.
+//
+// The frame options must match the firmware build (see src/link.h).
+// When the CRC is on, the decoder resynchronizes after lost bytes by
+// searching for the next offset at which a frame passes the check.
+//
+// With -a, the stream also carries archive blocks (ENABLE_ARCHIVE, see
+// src/archive.h), each one a frame of its own: a frame that fails the CRC
+// as a packet is tried as a block, so -a needs -c. The records of a block
+// are printed with the layout of the windows of the packets (-r), one
+// window per level of the cascade.
+//
+// With -b, the packets are composed (ENABLE_LINK_BUDGET, see src/pkt.h):
+// the header gives their windows, and so their length, and each window is
+// printed with its level (L<level>) and the fields that it carries.
+//
+// Usage: linkdec [-c] [-f] [-q] [-m] [-p] [-r] [-w windows] [-S stats] [-a block_size] [-b] [-e byte_error_rate] [-s seed] [file]
+//    -c    frames carry a CRC16
+//    -f    frames are FEC-encoded
+//    -q    packets carry a sequence number and event flag (ENABLE_TXQ)
+//    -m    packets carry a magnetometer calibration report (ENABLE_MAG_CAL)
+//    -p    packets carry the accelerometer spectral peaks (ENABLE_SPECTRUM)
+//    -r    windows are tagged with sensor ranges (ENABLE_AUTORANGE)
+//    -w    number of windows per packet (default: 2)
+//    -S    number of window statistics per packet (ENABLE_WINDOW_STATS)
+//    -a    archive blocks of the given size are sent too (ARCHIVE_BLOCK_SIZE)
+//    -b    packets are composed by a header (ENABLE_LINK_BUDGET); -w is ignored
+//    -e    inject random byte errors at the given rate before decoding,
+//          to evaluate the framing options without a radio
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "pkt.h"
+#include "link.h"
+#include "spectrum.h"
+#include "archive.h"
+
+#define MAX_FRAME 1024
+
+static int opt_crc = 0;
+static int opt_fec = 0;
+static int opt_seq = 0;
+static int opt_cal = 0;
+static int opt_peaks = 0;
+static int opt_range = 0;
+static unsigned opt_windows = 2;
+static unsigned opt_stats = 0;
+static unsigned opt_archive = 0;
+static int opt_compose = 0;
+
+// The payload of a packet: of every packet, or with -b, besides its windows
+// (and their range codes)
+static unsigned payload_len, frame_len;
+static unsigned min_frame_len, max_frame_len;
+static unsigned block_frame_len;
+
+static link_fec_stats_t fec_stats;
+
+#define SEQ_SIZE 2
+
+static unsigned count_bits(unsigned v)
+{
+    unsigned n = 0;
+    for (; v; v &= v - 1)
+        ++n;
+    return n;
+}
+
+/* The length of a composed packet from its header (in the first bytes of
+   the payload), or 0 if the header is not valid */
+static unsigned composed_len(const uint8_t *payload)
+{
+    const uint8_t *hdr = payload + (opt_seq ? SEQ_SIZE : 0);
+    unsigned levels = hdr[PKT_HDR_LEVELS], groups = hdr[PKT_HDR_GROUPS];
+    if (!levels || !groups || (groups & ~PKT_GROUPS_ALL))
+        return 0;
+    return payload_len + count_bits(levels) *
+           (pkt_win_size_groups(groups) + (opt_range ? PKT_RANGE_SIZE : 0));
+}
+
+static void print_windows(unsigned long idx, const uint8_t *payload)
+{
+    printf("frame %lu:", idx);
+    if (opt_seq) {
+        unsigned seq = payload[0] | (payload[1] << 8);
+        printf(" seq %u%s", seq & 0x7fff, (seq & 0x8000) ? " EVENT" : "");
+        payload += SEQ_SIZE;
+    }
+
+    unsigned windows = opt_windows, levels = 0, groups = PKT_GROUPS_ALL;
+    if (opt_compose) {
+        levels = payload[PKT_HDR_LEVELS];
+        groups = payload[PKT_HDR_GROUPS];
+        windows = count_bits(levels);
+        payload += PKT_HDR_SIZE;
+    }
+    unsigned win_size = pkt_win_size_groups(groups);
+
+    // Range codes follow everything else
+    const uint8_t *peaks_buf = payload + windows * win_size +
+                               opt_stats * PKT_STATS_SIZE + (opt_cal ? PKT_CAL_SIZE : 0);
+    const uint8_t *ranges = peaks_buf + (opt_peaks ? PKT_PEAKS_SIZE : 0);
+
+    unsigned level = 0;
+    for (unsigned w = 0; w < windows; ++w) {
+        if (opt_compose) {
+            while (!(levels & (1u << level)))
+                ++level;
+            printf(" L%u", level++);
+        }
+        pkt_win_t win;
+        pkt_win_unpack_groups(payload + w * win_size, &win, groups);
+        pkt_win_unscale(&win, &win);
+        if (opt_range) {
+            unsigned code = ranges[w * PKT_RANGE_SIZE];
+            pkt_win_unscale_range(&win, code);
+            printf(" r:%u/%u/%u", PKT_RANGE_MAG(code), PKT_RANGE_ACCEL(code),
+                   PKT_RANGE_GYRO(code));
+        }
+        const char *sep = " {";
+        for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f) {
+            if (groups & (1u << pkt_field_sensor(f))) {
+                printf("%s%s:%i", sep, pkt_field_name(f), win.v[f]);
+                sep = ",";
+            }
+        }
+        printf("}");
+    }
+    for (unsigned i = 0; i < opt_stats; ++i) {
+        pkt_stats_t stats;
+        pkt_stats_unpack(payload + windows * win_size + i * PKT_STATS_SIZE, &stats);
+        pkt_win_unscale(&stats.min, &stats.min);
+        pkt_win_unscale(&stats.max, &stats.max);
+        if (opt_range) {
+            // lvar stays in packed units of the range
+            unsigned code = ranges[(windows + i) * PKT_RANGE_SIZE];
+            pkt_win_unscale_range(&stats.min, code);
+            pkt_win_unscale_range(&stats.max, code);
+        }
+        // lvar: log2 of the variance in packed units (var < 2^lvar)
+        printf(" stats");
+        for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+            printf("%s%s:%i..%i/%i", f ? "," : " {", pkt_field_name(f),
+                   stats.min.v[f], stats.max.v[f], stats.lvar.v[f]);
+        printf("}");
+    }
+    if (opt_cal) {
+        pkt_cal_t cal;
+        pkt_cal_unpack(payload + windows * win_size + opt_stats * PKT_STATS_SIZE, &cal);
+        if (cal.axis == PKT_CAL_AXIS_NONE)
+            printf(" cal none");
+        else
+            printf(" cal %c: offset %i scale %i/%u",
+                   'x' + cal.axis, cal.offset, cal.scale, 1u << PKT_CAL_SCALE_SHIFT);
+    }
+    if (opt_peaks) {
+        pkt_peaks_t peaks;
+        pkt_peaks_unpack(peaks_buf, &peaks);
+        printf(" peaks %i:", peaks.seq);
+        for (unsigned i = 0; i < PKT_NUM_PEAKS; ++i) {
+            if (peaks.peak[i].power == 0)
+                continue;
+            // Amplitude of a tone on the bin: |X| = N A / 2, summed over the axes
+            double amp = 2.0 * sqrt(pow(2.0, (peaks.peak[i].power - 1) / 4.0)) / SPECTRUM_N;
+            printf(" %i/%u:%.0f", peaks.peak[i].bin, SPECTRUM_N, amp);
+        }
+    }
+    printf("\n");
+}
+
+/* Prints the records of an archive block, in the units of the packets */
+static void print_block(unsigned long idx, const uint8_t *block)
+{
+    unsigned seq = archive_block_seq(block);
+    unsigned len = block[2], values = block[3];
+    unsigned level_values = PKT_NUM_FIELDS + (opt_range ? 1 : 0);
+    printf("frame %lu: archive seq %u, %u bytes\n", idx, seq, len);
+    if (len < ARCHIVE_HDR_SIZE || len > opt_archive || values == 0) {
+        printf("  bad header\n");
+        return;
+    }
+
+    int16_t last[256] = { 0 }, v[256];
+    unsigned off = ARCHIVE_HDR_SIZE;
+    while (off < len) {
+        for (unsigned i = 0; i < values; ++i) {
+            unsigned n = archive_get(block + off, len - off, last[i], &v[i]);
+            if (!n) {
+                printf("  truncated record\n");
+                return;
+            }
+            off += n;
+        }
+        memcpy(last, v, values * sizeof(v[0]));
+
+        printf("  seq %u:", seq++);
+        if (values % level_values) {
+            // Not the layout of the windows: the values as they are
+            for (unsigned i = 0; i < values; ++i)
+                printf(" %i", v[i]);
+            printf("\n");
+            continue;
+        }
+        for (unsigned l = 0; l < values / level_values; ++l) {
+            const int16_t *lv = v + l * level_values;
+            pkt_win_t win;
+            for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+                win.v[f] = lv[f];
+            pkt_win_unscale(&win, &win);
+            if (opt_range) {
+                unsigned code = lv[PKT_NUM_FIELDS];
+                pkt_win_unscale_range(&win, code);
+                printf(" r:%u/%u/%u", PKT_RANGE_MAG(code), PKT_RANGE_ACCEL(code),
+                       PKT_RANGE_GYRO(code));
+            }
+            for (unsigned f = 0; f < PKT_NUM_FIELDS; ++f)
+                printf("%s%s:%i", f ? "," : " {", pkt_field_name(f), win.v[f]);
+            printf("}");
+        }
+        printf("\n");
+    }
+}
+
+static unsigned frame_size(unsigned len)
+{
+    unsigned raw_len = LINK_RAW_SIZE(len, opt_crc);
+    return opt_fec ? LINK_FEC_SIZE(raw_len) : raw_len;
+}
+
+/* Returns whether the frame of a payload of len bytes passes the CRC (or
+   true, without a CRC) */
+static int decode_frame(const uint8_t *frame, unsigned len, uint8_t *raw,
+                        link_fec_stats_t *stats)
+{
+    if (opt_fec)
+        link_fec_decode(raw, frame, frame_size(len), stats);
+    else
+        memcpy(raw, frame, LINK_RAW_SIZE(len, opt_crc));
+
+    if (!opt_crc)
+        return 1;
+
+    uint16_t crc = raw[len] | (raw[len + 1] << 8);
+    return crc == link_crc16_sw(raw, len);
+}
+
+enum { FRAME_NONE, FRAME_PACKET, FRAME_BLOCK };
+
+/* The length of the payload of the packet at the given position of the
+   stream: with -b, from its header (in the first FEC block), 0 if none */
+static unsigned packet_len_at(const uint8_t *stream, size_t len, size_t pos, uint8_t *raw)
+{
+    if (!opt_compose)
+        return payload_len;
+
+    unsigned hdr_end = (opt_seq ? SEQ_SIZE : 0) + PKT_HDR_SIZE;
+    if (opt_fec) {
+        link_fec_stats_t probe = { 0 };
+        unsigned coded = LINK_FEC_SIZE(hdr_end);
+        if (pos + coded > len)
+            return 0;
+        link_fec_decode(raw, stream + pos, coded, &probe);
+        return composed_len(raw);
+    }
+    if (pos + hdr_end > len)
+        return 0;
+    return composed_len(stream + pos);
+}
+
+/* Which frame, if any, checks out at the given position of the stream, and
+   the length of its payload */
+static int decode_at(const uint8_t *stream, size_t len, size_t pos, uint8_t *raw,
+                     link_fec_stats_t *stats, unsigned *payload)
+{
+    unsigned n = packet_len_at(stream, len, pos, raw);
+    if (n && pos + frame_size(n) <= len && decode_frame(stream + pos, n, raw, stats)) {
+        *payload = n;
+        return FRAME_PACKET;
+    }
+    if (opt_archive && pos + block_frame_len <= len) {
+        link_fec_stats_t probe = { 0 };
+        if (decode_frame(stream + pos, opt_archive, raw, &probe)) {
+            *stats = probe;
+            *payload = opt_archive;
+            return FRAME_BLOCK;
+        }
+    }
+    return FRAME_NONE;
+}
+
+int main(int argc, char **argv)
+{
+    double error_rate = 0.0;
+    unsigned seed = 1;
+    int c;
+
+    while ((c = getopt(argc, argv, "cfqmprw:S:a:be:s:")) != -1) {
+        switch (c) {
+            case 'c': opt_crc = 1; break;
+            case 'f': opt_fec = 1; break;
+            case 'q': opt_seq = 1; break;
+            case 'm': opt_cal = 1; break;
+            case 'p': opt_peaks = 1; break;
+            case 'r': opt_range = 1; break;
+            case 'w': opt_windows = atoi(optarg); break;
+            case 'S': opt_stats = atoi(optarg); break;
+            case 'a': opt_archive = atoi(optarg); break;
+            case 'b': opt_compose = 1; break;
+            case 'e': error_rate = atof(optarg); break;
+            case 's': seed = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-c] [-f] [-q] [-m] [-p] [-r] [-w windows] [-S stats] [-a block_size] [-b] [-e rate] [-s seed] [file]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    FILE *in = stdin;
+    if (optind < argc) {
+        in = fopen(argv[optind], "rb");
+        if (!in) {
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    unsigned windows = opt_compose ? 0 : opt_windows;
+    payload_len = (opt_seq ? SEQ_SIZE : 0) + (opt_compose ? PKT_HDR_SIZE : 0) +
+                  windows * PKT_WIN_SIZE + opt_stats * PKT_STATS_SIZE +
+                  (opt_cal ? PKT_CAL_SIZE : 0) + (opt_peaks ? PKT_PEAKS_SIZE : 0) +
+                  (opt_range ? (windows + opt_stats) * PKT_RANGE_SIZE : 0);
+    frame_len = frame_size(payload_len);
+    min_frame_len = max_frame_len = frame_len;
+    if (opt_compose) {
+        // From one byte of windows to all the levels with all the fields
+        min_frame_len = frame_size(payload_len + 1);
+        max_frame_len = frame_len = frame_size(payload_len + PKT_MAX_LEVELS *
+                                               (PKT_WIN_SIZE + (opt_range ? PKT_RANGE_SIZE : 0)));
+    }
+    if (frame_len > MAX_FRAME) {
+        fprintf(stderr, "frame too large: %u\n", frame_len);
+        return 1;
+    }
+    if (opt_archive) {
+        if (!opt_crc || opt_archive < ARCHIVE_HDR_SIZE || opt_archive > 255 ||
+            opt_archive == payload_len) {
+            fprintf(stderr, "-a needs -c, and a block size of %u to 255, not the packet size\n",
+                    ARCHIVE_HDR_SIZE);
+            return 1;
+        }
+        block_frame_len = frame_size(opt_archive);
+    }
+
+    size_t cap = 4096, len = 0;
+    uint8_t *stream = malloc(cap);
+    size_t n;
+    while ((n = fread(stream + len, 1, cap - len, in)) > 0) {
+        len += n;
+        if (len == cap)
+            stream = realloc(stream, cap *= 2);
+    }
+
+    srand(seed);
+    unsigned long injected = 0;
+    if (error_rate > 0.0) {
+        for (size_t i = 0; i < len; ++i) {
+            if ((double)rand() / RAND_MAX < error_rate) {
+                stream[i] ^= 1 + rand() % 255;
+                injected++;
+            }
+        }
+    }
+
+    uint8_t raw[LINK_FEC_SIZE(MAX_FRAME)];
+    unsigned long frames = 0, good = 0, blocks = 0, bad = 0, skipped = 0;
+    unsigned long good_bytes = 0;
+    size_t pos = 0;
+
+    while (pos + min_frame_len <= len) {
+        link_fec_stats_t stats = { 0 };
+
+        unsigned payload;
+        int kind = decode_at(stream, len, pos, raw, &stats, &payload);
+        fec_stats.corrected += stats.corrected;
+        fec_stats.uncorrectable += stats.uncorrectable;
+
+        if (kind == FRAME_PACKET) {
+            print_windows(frames++, raw);
+            good++;
+            good_bytes += payload;
+            pos += frame_size(payload);
+            continue;
+        }
+        if (kind == FRAME_BLOCK) {
+            print_block(frames++, raw);
+            blocks++;
+            good_bytes += payload;
+            pos += block_frame_len;
+            continue;
+        }
+
+        // Resync: look for the nearest offset at which a frame checks out
+        unsigned off;
+        for (off = 1; off < max_frame_len && pos + off + min_frame_len <= len; ++off) {
+            link_fec_stats_t probe = { 0 };
+            if (decode_at(stream, len, pos + off, raw, &probe, &payload) != FRAME_NONE)
+                break;
+        }
+        if (off < max_frame_len && pos + off + min_frame_len <= len) {
+            skipped += off;
+            pos += off;
+        } else {
+            printf("frame %lu: CRC error\n", frames++);
+            bad++;
+            pos += frame_len;
+        }
+    }
+
+    if (opt_compose)
+        fprintf(stderr, "received %zu bytes, frame %u to %u bytes (crc %u, fec %u)\n",
+                len, min_frame_len, max_frame_len, opt_crc, opt_fec);
+    else
+        fprintf(stderr, "received %zu bytes, frame %u bytes (payload %u, crc %u, fec %u)\n",
+                len, frame_len, payload_len, opt_crc, opt_fec);
+    if (injected)
+        fprintf(stderr, "injected byte errors: %lu\n", injected);
+    fprintf(stderr, "frames: %lu valid, %lu corrupted, %lu bytes skipped\n",
+            good, bad, skipped);
+    if (opt_archive)
+        fprintf(stderr, "archive: %lu blocks of %u bytes\n", blocks, opt_archive);
+    if (opt_fec)
+        fprintf(stderr, "fec: %u codewords corrected, %u uncorrectable\n",
+                fec_stats.corrected, fec_stats.uncorrectable);
+    fprintf(stderr, "goodput: %.1f%%\n",
+            len ? 100.0 * good_bytes / len : 0.0);
+
+    free(stream);
+    if (in != stdin)
+        fclose(in);
+    return 0;
+}
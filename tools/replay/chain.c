@@ -0,0 +1,78 @@
+// Host implementation of libchain (see include/libchain/chain.h)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include <libchain/chain.h>
+
+// Self channel fields written by the current task
+#define MAX_DIRTY 256
+
+// Outside of the app's memory, so persistent across reboots, like the
+// context in FRAM on the device
+static context_t context = { NULL, 1 };
+context_t *curctx = &context;
+
+void (*chain_on_transition)(task_t *from);
+
+static unsigned *dirty[MAX_DIRTY];
+static unsigned num_dirty;
+
+static jmp_buf task_jmp;
+
+unsigned chain_self_out(unsigned *idx)
+{
+    unsigned i;
+    for (i = 0; i < num_dirty && dirty[i] != idx; ++i)
+        ;
+    if (i == num_dirty) {
+        if (num_dirty == MAX_DIRTY) {
+            fprintf(stderr, "chain: too many self channel writes in %s\n",
+                    curctx->task->name);
+            exit(2);
+        }
+        dirty[num_dirty++] = idx;
+    }
+    return *idx ^ 1;
+}
+
+void *chain_in(void *value, size_t size, unsigned long time)
+{
+    if (time == 0)
+        memset(value, CHAIN_POISON, size);
+    return value;
+}
+
+void chain_abort(void)
+{
+    num_dirty = 0;
+}
+
+void transition_to(task_t *next)
+{
+    if (chain_on_transition)
+        chain_on_transition(curctx->task); // may reboot instead
+
+    for (unsigned i = 0; i < num_dirty; ++i)
+        *dirty[i] ^= 1;
+    num_dirty = 0;
+
+    curctx->task = next;
+    curctx->time++;
+    longjmp(task_jmp, 1);
+}
+
+/* Run the tasks from the current one on: the entry task on the first call */
+void chain_run(void)
+{
+    if (!curctx->task)
+        curctx->task = chain_entry_task;
+
+    setjmp(task_jmp);
+    curctx->task->func();
+
+    fprintf(stderr, "chain: %s returned without a transition\n", curctx->task->name);
+    exit(2);
+}
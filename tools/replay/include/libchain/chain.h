@@ -0,0 +1,127 @@
+#ifndef CHAIN_H
+#define CHAIN_H
+
+// Host implementation of the libchain API, for the replay build (see
+// bld/replay). It keeps the semantics the app relies on, not the layout:
+//
+//   - a read from several channels returns the most recent write (each
+//     write is stamped with the time, which advances at each transition)
+//   - writes to a self channel go to the other copy of the field, and take
+//     effect at the transition; reads in the same task see the old value
+//   - writes to any other channel take effect right away, and so do writes
+//     to a self channel field that FIELD_INIT_* leaves without an
+//     initializer: on the device, such a field has a single copy
+//   - a task ends in transition_to(), which does not return
+//
+// A reboot (chain_abort) drops the pending self channel writes, as power
+// loss before the transition does on the device.
+//
+// A read of a field that was never written returns CHAIN_POISON in every
+// byte rather than zeros, so that a task reading state no task has
+// initialized gets garbage, as it may on the device, instead of a zero that
+// happens to be a fine initial value.
+
+#define CHAIN_POISON 0xA5
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libmsp/mem.h>
+
+typedef struct _task_t {
+    void (*func)(void);
+    unsigned idx;
+    const char *name;
+} task_t;
+
+typedef struct {
+    task_t *task;
+    unsigned long time;
+} context_t;
+
+extern context_t *curctx;
+
+typedef struct {
+    bool self;
+} chan_meta_t;
+
+// Every field has two copies; only the self channel fields with an
+// initializer use the second one
+#define CHAIN_FIELD_TYPE(type) \
+    struct { unsigned idx; bool self; struct { type value; unsigned long time; } var[2]; }
+
+#define CHAN_FIELD(type, name)                  CHAIN_FIELD_TYPE(type) name
+#define CHAN_FIELD_ARRAY(type, name, size)      CHAIN_FIELD_TYPE(type) name[size]
+#define SELF_CHAN_FIELD(type, name)             CHAIN_FIELD_TYPE(type) name
+#define SELF_CHAN_FIELD_ARRAY(type, name, size) CHAIN_FIELD_TYPE(type) name[size]
+
+#define SELF_FIELD_INITIALIZER { 0, true }
+#define SELF_FIELD_ARRAY_INITIALIZER(size) { [0 ... (size) - 1] = SELF_FIELD_INITIALIZER }
+
+#define CHAIN_CHAN_TYPE(type) struct { chan_meta_t meta; struct type data; }
+
+#define TASK(idx, func) \
+    void func(void); \
+    task_t _task_ ## func = { func, idx, #func };
+
+#define TASK_REF(func) (&_task_ ## func)
+
+#define CHANNEL(src, dest, type) \
+    __nv CHAIN_CHAN_TYPE(type) _ch_ ## src ## _ ## dest = { { false } }
+
+#define SELF_CHANNEL(task, type) \
+    __nv CHAIN_CHAN_TYPE(type) _ch_ ## task ## _ ## task = \
+        { { true }, FIELD_INIT_ ## type }
+
+#define MULTICAST_CHANNEL(type, name, src, ...) \
+    __nv CHAIN_CHAN_TYPE(type) _ch_mc_ ## src ## _ ## name = { { false } }
+
+#define CH(src, dest) (&_ch_ ## src ## _ ## dest)
+#define SELF_IN_CH(task) CH(task, task)
+#define SELF_OUT_CH(task) CH(task, task)
+#define MC_OUT_CH(name, src, ...) (&_ch_mc_ ## src ## _ ## name)
+#define MC_IN_CH(name, src, dest) (&_ch_mc_ ## src ## _ ## name)
+
+#define CHAIN_VAR(field, chan) \
+    ((chan)->data.field.var[(chan)->data.field.idx])
+
+// Time 0: never written (the time starts at 1)
+#define CHAN_IN1(type, field, chan0) \
+    ((type *)chain_in(&CHAIN_VAR(field, chan0).value, sizeof(type), \
+                      CHAIN_VAR(field, chan0).time))
+
+#define CHAN_IN2(type, field, chan0, chan1) \
+    (CHAIN_VAR(field, chan0).time >= CHAIN_VAR(field, chan1).time ? \
+        CHAN_IN1(type, field, chan0) : CHAN_IN1(type, field, chan1))
+
+#define CHAN_IN3(type, field, chan0, chan1, chan2) \
+    (CHAIN_VAR(field, chan0).time >= CHAIN_VAR(field, chan1).time ? \
+        CHAN_IN2(type, field, chan0, chan2) : CHAN_IN2(type, field, chan1, chan2))
+
+#define CHAN_OUT1(type, field, val, chan0) do { \
+        __typeof__((chan0)->data.field) *_f = &(chan0)->data.field; \
+        unsigned _i = (chan0)->meta.self && _f->self ? chain_self_out(&_f->idx) : 0; \
+        _f->var[_i].value = (val); \
+        _f->var[_i].time = curctx->time; \
+    } while (0)
+
+#define TRANSITION_TO(task) transition_to(TASK_REF(task))
+
+#define INIT_FUNC(func) void chain_init(void) { func(); }
+#define ENTRY_TASK(task) task_t *chain_entry_task = TASK_REF(task);
+
+void transition_to(task_t *next) __attribute__((noreturn));
+unsigned chain_self_out(unsigned *idx);
+void *chain_in(void *value, size_t size, unsigned long time);
+
+// Provided by the app (INIT_FUNC, ENTRY_TASK)
+void chain_init(void);
+extern task_t *chain_entry_task;
+
+// For the replay driver
+void chain_run(void) __attribute__((noreturn));
+void chain_abort(void);
+extern void (*chain_on_transition)(task_t *from);
+
+#endif // CHAIN_H
@@ -0,0 +1,6 @@
+#ifndef LIBHARVEST_CHARGE_H
+#define LIBHARVEST_CHARGE_H
+
+static inline void harvest_charge(void) { }
+
+#endif // LIBHARVEST_CHARGE_H
@@ -0,0 +1,9 @@
+#ifndef LIBIO_CONSOLE_H
+#define LIBIO_CONSOLE_H
+
+// No console in the replay: the log would dominate the run time
+#define LOG(...)
+#define LOG2(...)
+#define INIT_CONSOLE()
+
+#endif // LIBIO_CONSOLE_H
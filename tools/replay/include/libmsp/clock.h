@@ -0,0 +1,6 @@
+#ifndef LIBMSP_CLOCK_H
+#define LIBMSP_CLOCK_H
+
+static inline void msp_clock_setup(void) { }
+
+#endif // LIBMSP_CLOCK_H
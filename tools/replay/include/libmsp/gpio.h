@@ -0,0 +1,6 @@
+#ifndef LIBMSP_GPIO_H
+#define LIBMSP_GPIO_H
+
+static inline void msp_gpio_unlock(void) { }
+
+#endif // LIBMSP_GPIO_H
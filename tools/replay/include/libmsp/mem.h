@@ -0,0 +1,8 @@
+#ifndef LIBMSP_MEM_H
+#define LIBMSP_MEM_H
+
+// Persistent across the reboots of the replay: outside of the sections
+// that the replay resets (see bld/replay/Makefile)
+#define __nv __attribute__((section(".nv_vars")))
+
+#endif // LIBMSP_MEM_H
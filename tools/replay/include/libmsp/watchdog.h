@@ -0,0 +1,6 @@
+#ifndef LIBMSP_WATCHDOG_H
+#define LIBMSP_WATCHDOG_H
+
+static inline void msp_watchdog_disable(void) { }
+
+#endif // LIBMSP_WATCHDOG_H
@@ -0,0 +1,11 @@
+#ifndef LIBMSPUARTLINK_UARTLINK_H
+#define LIBMSPUARTLINK_UARTLINK_H
+
+#include <stdint.h>
+
+// The radio: replay.c collects the packets
+void uartlink_open_tx(void);
+void uartlink_send(uint8_t *payload, unsigned len);
+void uartlink_close(void);
+
+#endif // LIBMSPUARTLINK_UARTLINK_H
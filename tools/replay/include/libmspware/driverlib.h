@@ -0,0 +1,6 @@
+#ifndef DRIVERLIB_H
+#define DRIVERLIB_H
+
+#include <msp430.h>
+
+#endif // DRIVERLIB_H
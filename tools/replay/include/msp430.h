@@ -0,0 +1,33 @@
+#ifndef MSP430_H
+#define MSP430_H
+
+// The registers used by the app sources in the replay build (see
+// bld/replay), as plain variables, except for the CRC16 module, which is
+// emulated (see replay.c)
+
+#include <stdint.h>
+
+#define BIT0 0x01
+#define BIT1 0x02
+#define BIT2 0x04
+#define BIT3 0x08
+#define BIT4 0x10
+#define BIT5 0x20
+#define BIT6 0x40
+#define BIT7 0x80
+
+extern volatile uint8_t P1DIR, P1OUT, P2DIR, P2OUT, P3DIR, P3OUT,
+                        P4DIR, P4OUT, PJDIR, PJOUT;
+
+// CRC16: a write of CRCDIRB_L feeds the byte, CRCINIRES is the seed or
+// the result. The accessors feed the last byte written before they return.
+uint16_t *replay_crc_res(void);
+uint8_t *replay_crc_dirb(void);
+#define CRCINIRES (*replay_crc_res())
+#define CRCDIRB_L (*replay_crc_dirb())
+
+#define __delay_cycles(n) ((void)(n))
+#define __enable_interrupt() ((void)0)
+#define __disable_interrupt() ((void)0)
+
+#endif // MSP430_H
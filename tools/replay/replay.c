@@ -0,0 +1,494 @@
+// Replay of a sensor trace through the app on the host (see bld/replay).
+//
+// The drivers of the sensors return the readings of the trace (recorded
+// with ENABLE_TRACE, see src/trace.h), in order, and the radio prints each
+// packet as a line of hex bytes. The task graph runs flat out on the host
+// libchain (include/libchain/chain.h), from a fresh FRAM, so the trace
+// must start with the first boot after programming.
+//
+// A boot record is a reboot: the power fails at the end of the next run of
+// the task it names (before its transition), or before the next reading
+// if that comes first. The reboot resets the app's volatile memory (its
+// .data and .bss; __nv variables and channels persist) and runs the init
+// again, which sees the sensors come up as recorded: the init or the
+// check of each sensor (ENABLE_WARM_BOOT) returns what the record says.
+//
+// With ENABLE_JIT_COALESCE, the energy is low from the last reading before
+// each reboot on, as if the comparator tripped ahead of the power failure,
+// and high otherwise. The replay reports the transitions (each a commit of
+// the channels on the device) per packet.
+//
+// With -l, the radio emulates a link that carries the given number of
+// bytes per run of the cascade: the frame sent by DMA (ENABLE_UART_DMA) is
+// still that much short of out at the next run (see uartdma_pending).
+//
+// With -g, the packets are compared with a golden packet stream (the
+// output of an earlier replay, or a capture in the same format), and the
+// exit status is 1 if they differ. The replay ends at the end of the
+// trace, and reports its speed on stderr.
+//
+// Usage: replay [-l bytes] [-g golden] [trace]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <msp430.h>
+#include <libchain/chain.h>
+
+#include "trace.h"
+#include "temp_sensor.h"
+#include "magnetometer.h"
+#include "lsm.h"
+#include "sample_clock.h"
+#include "uartdma.h"
+#include "energy.h"
+
+#define MAX_PKT 256
+#define MAX_SHOWN_DIFFS 8
+
+typedef struct {
+    char kind;  // b t m l
+    bool fail;  // m, l: the read failed with v[0]
+    int v[6];
+    unsigned line;
+} rec_t;
+
+typedef struct {
+    uint8_t bytes[MAX_PKT];
+    unsigned len;
+} pkt_rec_t;
+
+static rec_t *recs;
+static unsigned num_recs, next_rec;
+
+static pkt_rec_t *golden;
+static unsigned num_golden;
+static bool check_golden;
+static unsigned num_diffs;
+
+static unsigned link_rate; // bytes per run of the cascade, 0: no limit
+static unsigned dma_len;
+
+static bool boot_mag_ok = true, boot_lsm_ok = true;
+static bool boot_mag_warm, boot_lsm_warm;
+static unsigned long samples, readings;
+static unsigned boots, packets;
+static unsigned long transitions;
+static struct timespec t_start;
+
+static jmp_buf boot_jmp;
+
+// The app's volatile memory (see bld/replay/Makefile)
+extern char __start_app_data[], __stop_app_data[];
+extern char __start_app_bss[], __stop_app_bss[];
+static char *app_data_init;
+
+volatile uint8_t P1DIR, P1OUT, P2DIR, P2OUT, P3DIR, P3OUT, P4DIR, P4OUT, PJDIR, PJOUT;
+
+static void load_trace(FILE *in)
+{
+    unsigned cap = 0, line = 0;
+    char buf[256];
+
+    while (fgets(buf, sizeof(buf), in)) {
+        ++line;
+        const char *p = strstr(buf, TRACE_PREFIX);
+        if (!p)
+            continue;
+        p += strlen(TRACE_PREFIX);
+
+        rec_t r = { .kind = *p, .line = line };
+        int n = 0;
+        switch (r.kind) {
+            case 'b':
+                // Without the warm flags (older traces): cold
+                n = sscanf(p + 1, "%d %d %d %d %d", &r.v[0], &r.v[1], &r.v[2],
+                           &r.v[3], &r.v[4]) >= 3;
+                break;
+            case 't':
+                n = sscanf(p + 1, "%d", &r.v[0]) == 1;
+                break;
+            case 'm':
+            case 'l':
+                if (sscanf(p + 1, " ! %d", &r.v[0]) == 1) {
+                    r.fail = true;
+                    n = 1;
+                } else if (r.kind == 'm') {
+                    n = sscanf(p + 1, "%d %d %d", &r.v[0], &r.v[1], &r.v[2]) == 3;
+                } else {
+                    n = sscanf(p + 1, "%d %d %d %d %d %d", &r.v[0], &r.v[1], &r.v[2],
+                               &r.v[3], &r.v[4], &r.v[5]) == 6;
+                }
+                break;
+        }
+        if (!n) {
+            fprintf(stderr, "trace line %u: bad record\n", line);
+            exit(2);
+        }
+
+        if (num_recs == cap) {
+            cap = cap ? 2 * cap : 4096;
+            recs = realloc(recs, cap * sizeof(rec_t));
+        }
+        recs[num_recs++] = r;
+    }
+}
+
+static void load_golden(FILE *in)
+{
+    unsigned cap = 0;
+    char buf[4 * MAX_PKT];
+
+    while (fgets(buf, sizeof(buf), in)) {
+        pkt_rec_t pkt = { .len = 0 };
+        char *p = buf, *end;
+        unsigned long b;
+        while (pkt.len < MAX_PKT && (b = strtoul(p, &end, 16), end != p)) {
+            pkt.bytes[pkt.len++] = b;
+            p = end;
+        }
+
+        if (num_golden == cap) {
+            cap = cap ? 2 * cap : 1024;
+            golden = realloc(golden, cap * sizeof(pkt_rec_t));
+        }
+        golden[num_golden++] = pkt;
+    }
+}
+
+static void finish(void) __attribute__((noreturn));
+static void finish(void)
+{
+    struct timespec t_end;
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    double secs = (t_end.tv_sec - t_start.tv_sec) + (t_end.tv_nsec - t_start.tv_nsec) * 1e-9;
+
+    fprintf(stderr, "replay: %lu samples (%lu readings), %u reboots, %u packets in %.3f s"
+            ": %.0f samples/s", samples, readings, boots, packets, secs,
+            secs > 0 ? samples / secs : 0.0);
+#ifdef ENABLE_SAMPLE_CLOCK
+    // The mission time of the trace, at one sample per tick
+    fprintf(stderr, ", %.0fx real time", secs > 0 ? samples / (secs * SAMPLE_CLOCK_HZ) : 0.0);
+#endif // ENABLE_SAMPLE_CLOCK
+    fprintf(stderr, ", %lu transitions (%.1f per packet)", transitions,
+            packets ? (double)transitions / packets : 0.0);
+    fprintf(stderr, "\n");
+
+    if (!check_golden)
+        exit(0);
+
+    if (packets != num_golden) {
+        fprintf(stderr, "replay: %u packets, golden has %u\n", packets, num_golden);
+        ++num_diffs;
+    }
+    if (num_diffs) {
+        fprintf(stderr, "replay: differs from golden\n");
+        exit(1);
+    }
+    fprintf(stderr, "replay: matches golden\n");
+    exit(0);
+}
+
+/* The sensors as the boot record has them */
+static void set_boot(const rec_t *r)
+{
+    boot_mag_ok = r->v[1];
+    boot_lsm_ok = r->v[2];
+    boot_mag_warm = r->v[3];
+    boot_lsm_warm = r->v[4];
+}
+
+/* Power failure: start over from the init, with the volatile memory reset */
+static void reboot(void) __attribute__((noreturn));
+static void reboot(void)
+{
+    set_boot(&recs[next_rec++]);
+    ++boots;
+    longjmp(boot_jmp, 1);
+}
+
+static const rec_t *next_reading(char kind)
+{
+    if (next_rec == num_recs)
+        finish();
+    if (recs[next_rec].kind == 'b')
+        reboot();
+
+    const rec_t *r = &recs[next_rec++];
+    if (r->kind != kind) {
+        fprintf(stderr, "trace line %u: expected a '%c' record, got '%c'"
+                " (is the build configured as the recording one?)\n",
+                r->line, kind, r->kind);
+        exit(2);
+    }
+    ++readings;
+    return r;
+}
+
+static void on_transition(task_t *from)
+{
+    if (next_rec < num_recs && recs[next_rec].kind == 'b' &&
+        (unsigned)recs[next_rec].v[0] == from->idx)
+        reboot();
+    ++transitions;
+}
+
+static void send(const uint8_t *payload, unsigned len)
+{
+    for (unsigned i = 0; i < len; ++i)
+        printf(i ? " %02x" : "%02x", payload[i]);
+    printf("\n");
+
+    if (check_golden) {
+        const pkt_rec_t *g = packets < num_golden ? &golden[packets] : NULL;
+        if (g && (g->len != len || memcmp(g->bytes, payload, len))) {
+            if (num_diffs < MAX_SHOWN_DIFFS)
+                fprintf(stderr, "replay: packet %u differs from golden\n", packets);
+            ++num_diffs;
+        }
+    }
+    ++packets;
+}
+
+// Sensors
+
+void i2c_setup(void)
+{
+}
+
+void init_temp_sensor()
+{
+}
+
+signed short read_temperature_sensor()
+{
+    const rec_t *r = next_reading('t');
+    ++samples;
+    return r->v[0];
+}
+
+bool magnetometer_init(void)
+{
+    return boot_mag_ok;
+}
+
+bool magnetometer_check(void)
+{
+    return boot_mag_warm;
+}
+
+int magnetometer_read(magnet_t *coordinates)
+{
+    const rec_t *r = next_reading('m');
+    if (r->fail)
+        return r->v[0];
+    coordinates->x = r->v[0];
+    coordinates->y = r->v[1];
+    coordinates->z = r->v[2];
+    return I2C_OK;
+}
+
+int magnetometer_set_gain(unsigned gain)
+{
+    (void)gain;
+    return I2C_OK;
+}
+
+bool lsm_init()
+{
+    return boot_lsm_ok;
+}
+
+bool lsm_check()
+{
+    return boot_lsm_warm;
+}
+
+int lsm_sample(lsm_t *sample)
+{
+    const rec_t *r = next_reading('l');
+    if (r->fail)
+        return r->v[0];
+    sample->ax = r->v[0];
+    sample->ay = r->v[1];
+    sample->az = r->v[2];
+    sample->gx = r->v[3];
+    sample->gy = r->v[4];
+    sample->gz = r->v[5];
+    return I2C_OK;
+}
+
+int lsm_set_range(unsigned accel, unsigned gyro)
+{
+    (void)accel;
+    (void)gyro;
+    return I2C_OK;
+}
+
+int lsm_set_odr(unsigned odr)
+{
+    (void)odr;
+    return I2C_OK;
+}
+
+// Sample clock: every wait is one tick, and the cascade never has to
+// yield to a sample (the host is infinitely fast)
+
+static sample_tick_t tick;
+
+void sample_clock_init()
+{
+}
+
+sample_tick_t sample_clock_wait()
+{
+    return ++tick;
+}
+
+bool sample_clock_pending()
+{
+    return false;
+}
+
+// Radio
+
+void uartlink_open_tx(void)
+{
+}
+
+void uartlink_send(uint8_t *payload, unsigned len)
+{
+    send(payload, len);
+}
+
+void uartlink_close(void)
+{
+}
+
+void uartdma_send(const uint8_t *buf, unsigned len)
+{
+    dma_len = len;
+    send(buf, len);
+}
+
+unsigned uartdma_pending(void)
+{
+    return link_rate && dma_len > link_rate ? dma_len - link_rate : 0;
+}
+
+void uartdma_wait(void)
+{
+    dma_len = 0;
+}
+
+bool uartdma_busy(void)
+{
+    return false;
+}
+
+void uartdma_resume(void)
+{
+}
+
+// Energy monitor
+
+void energy_init(void)
+{
+}
+
+bool energy_high(void)
+{
+    return !(next_rec < num_recs && recs[next_rec].kind == 'b');
+}
+
+// CRC16 module (see msp430.h): CRC-16-CCITT, MSB first
+
+static uint16_t crc_res;
+static uint8_t crc_in;
+static bool crc_pending;
+
+static void crc_feed(void)
+{
+    if (!crc_pending)
+        return;
+    crc_res ^= (uint16_t)crc_in << 8;
+    for (unsigned b = 0; b < 8; ++b)
+        crc_res = (crc_res & 0x8000) ? (uint16_t)((crc_res << 1) ^ 0x1021) : (uint16_t)(crc_res << 1);
+    crc_pending = false;
+}
+
+uint16_t *replay_crc_res(void)
+{
+    crc_feed();
+    return &crc_res;
+}
+
+uint8_t *replay_crc_dirb(void)
+{
+    crc_feed();
+    crc_pending = true;
+    return &crc_in;
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "l:g:")) != -1) {
+        switch (c) {
+            case 'l':
+                link_rate = atoi(optarg);
+                break;
+            case 'g': {
+                FILE *f = fopen(optarg, "r");
+                if (!f) {
+                    perror(optarg);
+                    return 2;
+                }
+                load_golden(f);
+                fclose(f);
+                check_golden = true;
+                break;
+            }
+            default:
+                fprintf(stderr, "usage: %s [-l bytes] [-g golden] [trace]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    FILE *in = stdin;
+    if (optind < argc) {
+        in = fopen(argv[optind], "r");
+        if (!in) {
+            perror(argv[optind]);
+            return 2;
+        }
+    }
+    load_trace(in);
+
+    // The first boot is the power-on
+    if (num_recs > 0 && recs[0].kind == 'b') {
+        set_boot(&recs[0]);
+        next_rec = 1;
+    }
+
+    size_t data_size = __stop_app_data - __start_app_data;
+    app_data_init = malloc(data_size);
+    memcpy(app_data_init, __start_app_data, data_size);
+
+    chain_on_transition = on_transition;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+    if (setjmp(boot_jmp)) {
+        chain_abort();
+        memcpy(__start_app_data, app_data_init, data_size);
+        memset(__start_app_bss, 0, __stop_app_bss - __start_app_bss);
+    }
+
+    chain_init();
+    chain_run();
+}